@@ -40,6 +40,7 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t) const {
+        RT_STAT_INC(box_tests);
         const point3& ray_orig = r.origin();
         const vec3&   ray_dir  = r.direction();
 
@@ -74,6 +75,11 @@ public:
             return y.size() > z.size() ? 1 : 2;
     }
 
+    double surface_area() const {
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+
     static const aabb empty, universe;
 
 private:
@@ -0,0 +1,183 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "rt.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "cuboid.h"
+#include "framebuffer.h"
+#include "hittable_list.h"
+#include "sphere.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Values keyed by time (in seconds), linearly interpolated between keys and held constant
+// before the first and after the last key.
+template <typename T>
+class keyframes {
+public:
+    keyframes() = default;
+    keyframes(std::initializer_list<std::pair<double, T>> keys) {
+        for (const auto& [time, value] : keys)
+            add(time, value);
+    }
+
+    void add(double time, const T& value) {
+        auto position = std::find_if(keys.begin(), keys.end(),
+                                     [&](const auto& key) { return key.first > time; });
+        keys.insert(position, {time, value});
+    }
+
+    [[nodiscard]] bool empty() const { return keys.empty(); }
+
+    [[nodiscard]] T at(double time) const {
+        if (time <= keys.front().first) return keys.front().second;
+        if (time >= keys.back().first) return keys.back().second;
+
+        auto next = std::find_if(keys.begin(), keys.end(),
+                                 [&](const auto& key) { return key.first > time; });
+        auto prev = next - 1;
+        auto s = (time - prev->first) / (next->first - prev->first);
+        return (1 - s) * prev->second + s * next->second;
+    }
+
+private:
+    std::vector<std::pair<double, T>> keys;
+};
+
+// Everything that changes over an animation: the camera path and any number of object tracks.
+// Object tracks move geometry in place (sphere centers, translate offsets, box positions); the BVH over the
+// scene has to be refit or rebuilt after they are applied.
+class animation {
+public:
+    int first_frame = 0;
+    int last_frame = 47;
+    double fps = 24;
+
+    keyframes<point3> camera_lookfrom;
+    keyframes<point3> camera_lookat;
+
+    void add_track(std::function<void(double time)> apply) {
+        tracks.push_back(std::move(apply));
+    }
+
+    void keyframe_center(const shared_ptr<sphere>& object, keyframes<point3> centers) {
+        add_track([object, centers = std::move(centers)](double time) {
+            object->set_center(centers.at(time));
+        });
+    }
+
+    void keyframe_offset(const shared_ptr<translate>& object, keyframes<vec3> offsets) {
+        add_track([object, offsets = std::move(offsets)](double time) {
+            object->set_offset(offsets.at(time));
+        });
+    }
+
+    void keyframe_position(const shared_ptr<cuboid>& object, keyframes<point3> positions) {
+        add_track([object, positions = std::move(positions)](double time) {
+            object->set_position(positions.at(time));
+        });
+    }
+
+    // Poses the camera and every object for the given time.
+    void apply(double time, camera& cam) const {
+        if (!camera_lookfrom.empty()) cam.lookfrom = camera_lookfrom.at(time);
+        if (!camera_lookat.empty())   cam.lookat   = camera_lookat.at(time);
+        for (const auto& track : tracks)
+            track(time);
+    }
+
+    [[nodiscard]] double frame_time(int frame) const { return frame / fps; }
+
+private:
+    std::vector<std::function<void(double)>> tracks;
+};
+
+struct animation_options {
+    std::string frames_dir = "frames";
+    double rebuild_threshold = 1.5;     // Rebuild once SAH cost exceeds this times the built cost
+};
+
+// Renders every frame of the animation to frames_dir/frame_NNNN.ppm. The BVH is built once and
+// then refit between frames; it is only rebuilt when refitting has degraded its SAH cost past
+// the threshold relative to the last build. Prints one JSON line per frame and a summary.
+inline int render_animation(hittable_list& objects, camera& cam, const animation& anim,
+                            const animation_options& options, std::ostream& out) {
+    std::error_code error;
+    std::filesystem::create_directories(options.frames_dir, error);
+
+    shared_ptr<bvh_node> tree;
+    double built_cost = 0;
+
+    double total_update = 0, total_render = 0;
+    std::uint64_t total_rays = 0;
+    int rebuilds = 0;
+
+    for (int frame = anim.first_frame; frame <= anim.last_frame; frame++) {
+        auto update_start = std::chrono::steady_clock::now();
+        anim.apply(anim.frame_time(frame), cam);
+
+        const char* update = "build";
+        if (!tree) {
+            tree = make_shared<bvh_node>(objects);
+            built_cost = tree->sah_cost();
+        }
+        else {
+            tree->refit();
+            update = "refit";
+            if (tree->sah_cost() > options.rebuild_threshold * built_cost) {
+                tree = make_shared<bvh_node>(objects);
+                built_cost = tree->sah_cost();
+                update = "rebuild";
+                rebuilds++;
+            }
+        }
+        std::chrono::duration<double> update_time = std::chrono::steady_clock::now() - update_start;
+        auto cost_ratio = tree->sah_cost() / built_cost;
+
+        auto render_start = std::chrono::steady_clock::now();
+        auto fb = cam.make_framebuffer();
+        auto rays = cam.render_samples(*tree, fb, cam.samples_per_pixel);
+        std::chrono::duration<double> render_time = std::chrono::steady_clock::now() - render_start;
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "/frame_%04d.ppm", frame);
+        if (!write_ppm(options.frames_dir + name, fb)) {
+            std::cerr << "Error: could not write " << options.frames_dir + name << '\n';
+            return 1;
+        }
+
+        total_update += update_time.count();
+        total_render += render_time.count();
+        total_rays += rays;
+
+        out << "{\"frame\": " << frame << ", \"bvh_update\": \"" << update << "\""
+            << ", \"bvh_update_seconds\": " << update_time.count()
+            << ", \"sah_cost_ratio\": " << cost_ratio
+            << ", \"render_seconds\": " << render_time.count()
+            << ", \"mrays_per_second\": " << double(rays) / render_time.count() / 1e6
+            << "}" << std::endl;
+    }
+
+    auto frames = anim.last_frame - anim.first_frame + 1;
+    auto total = total_update + total_render;
+    out << "{\"frames\": " << frames << ", \"bvh_rebuilds\": " << rebuilds
+        << ", \"bvh_update_seconds\": " << total_update
+        << ", \"render_seconds\": " << total_render
+        << ", \"frames_per_second\": " << frames / total
+        << ", \"mrays_per_second\": " << double(total_rays) / total / 1e6
+        << "}" << std::endl;
+    return 0;
+}
+
+#endif //ANIMATION_H
@@ -0,0 +1,171 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "rt.h"
+
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Owns every object of a scene (primitives, materials, textures, BVH nodes) in typed pools.
+//
+// Objects of one type are packed into large blocks, so a BVH and its primitives sit close
+// together in memory instead of being spread over the heap with one control block each. Each
+// thread allocates from its own block per type and only takes the arena lock to fetch a new
+// block, so scenes and BVHs built in parallel do not contend on the allocator.
+//
+// make() returns non-owning handles: shared_ptrs without a control block, which copy and
+// destroy without touching a reference count. They stay valid until the arena is destroyed,
+// so the arena has to outlive every hittable_list, BVH and camera render that uses them.
+// Destroying the arena frees whole blocks; types with trivial destructors are not visited.
+//
+// Blocks are carved from 2 MiB slabs mapped with allocate_pages, so the arena can be backed
+// by huge pages, and each block's pages land on the NUMA node of the thread that fills it.
+class scene_arena {
+public:
+    explicit scene_arena(page_mode pages = default_page_mode()) : id(next_id++), pages(pages) {}
+
+    ~scene_arena() {
+        for (auto it = pools.rbegin(); it != pools.rend(); ++it)
+            if (*it)
+                (*it)->destroy();
+        for (const auto& slab : slabs)
+            free_pages(slab);
+    }
+
+    scene_arena(const scene_arena&) = delete;
+    scene_arena& operator=(const scene_arena&) = delete;
+
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args) {
+        // The block cache is per thread and per type; the arena id tells it apart from a
+        // cache filled by another (possibly since destroyed) arena.
+        thread_local block<T>* current = nullptr;
+        thread_local std::uint64_t current_arena = 0;
+
+        if (current_arena != id || current->used == block<T>::capacity) {
+            current = new_block<T>();
+            current_arena = id;
+        }
+
+        // Claim the slot before constructing: constructors such as bvh_node's allocate further
+        // objects of the same type from this arena.
+        auto* b = current;
+        auto slot = b->used++;
+        try {
+            auto* object = ::new (b->slot(slot)) T(std::forward<Args>(args)...);
+            return shared_ptr<T>(shared_ptr<T>(), object);
+        }
+        catch (...) {
+            b->dead.push_back(slot);
+            throw;
+        }
+    }
+
+    // Total size of the slabs mapped so far.
+    [[nodiscard]] size_t bytes() const { return allocated.load(std::memory_order_relaxed); }
+
+private:
+    template <typename T>
+    struct block {
+        static constexpr size_t capacity = std::max<size_t>(1, (64 * 1024) / sizeof(T));
+
+        size_t used = 0;
+        std::vector<size_t> dead;       // Slots whose constructor threw
+        alignas(T) unsigned char storage[capacity * sizeof(T)];
+
+        void* slot(size_t index) { return storage + index * sizeof(T); }
+        T* object(size_t index) { return std::launder(reinterpret_cast<T*>(slot(index))); }
+    };
+
+    struct pool_base {
+        virtual ~pool_base() = default;
+        virtual void destroy() = 0;
+    };
+
+    template <typename T>
+    struct pool : pool_base {
+        std::vector<block<T>*> blocks;
+
+        void destroy() override {
+            for (auto* b : blocks) {
+                if constexpr (!std::is_trivially_destructible_v<T>) {
+                    for (size_t i = b->used; i-- > 0;)
+                        if (std::find(b->dead.begin(), b->dead.end(), i) == b->dead.end())
+                            b->object(i)->~T();
+                }
+                b->~block();
+            }
+            blocks.clear();
+        }
+    };
+
+    static inline std::atomic<std::uint64_t> next_id{1};
+    static inline std::atomic<size_t> next_type_slot{0};
+
+    template <typename T>
+    static size_t type_slot() {
+        static const size_t slot = next_type_slot++;
+        return slot;
+    }
+
+    template <typename T>
+    block<T>* new_block() {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto* b = ::new (carve(sizeof(block<T>), alignof(block<T>))) block<T>;
+
+        auto slot = type_slot<T>();
+        if (pools.size() <= slot)
+            pools.resize(slot + 1);
+        if (!pools[slot])
+            pools[slot] = std::make_unique<pool<T>>();
+        static_cast<pool<T>*>(pools[slot].get())->blocks.push_back(b);
+        return b;
+    }
+
+    // Takes the next suitably aligned piece of the current slab, mapping a new slab if it
+    // does not fit. Called with the mutex held.
+    void* carve(size_t size, size_t alignment) {
+        constexpr size_t slab_size = huge_page_size;
+        auto offset = (slab_used + alignment - 1) / alignment * alignment;
+        if (slabs.empty() || offset + size > slabs.back().size) {
+            slabs.push_back(allocate_pages(std::max(size, slab_size), pages));
+            allocated.fetch_add(slabs.back().size, std::memory_order_relaxed);
+            offset = 0;
+        }
+        slab_used = offset + size;
+        return static_cast<unsigned char*>(slabs.back().data) + offset;
+    }
+
+    const std::uint64_t id;
+    const page_mode pages;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<pool_base>> pools;
+    std::vector<page_allocation> slabs;
+    size_t slab_used = 0;
+    std::atomic<size_t> allocated{0};
+};
+
+// Allocates from the arena if there is one, otherwise as an ordinary shared object. Lets
+// helpers such as the BVH builders and box() serve both arena and heap-built scenes.
+template <typename T, typename... Args>
+shared_ptr<T> make_object(scene_arena* arena, Args&&... args) {
+    if (arena)
+        return arena->make<T>(std::forward<Args>(args)...);
+    return make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif //ARENA_H
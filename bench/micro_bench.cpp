@@ -0,0 +1,296 @@
+// Micro-benchmarks for the intersection, traversal and sampling kernels.
+//
+// Every benchmark runs from a fixed seed, so two builds see exactly the same rays and
+// scenes. Results are printed one JSON object per line:
+//
+//   {"name": "sphere_hit", "iterations": 4194304, "ns_per_op": 9.8, "ops_per_second": 1.0e+08}
+//
+// Ray-casting benchmarks also report "rays_per_second" (the same number, under the name the
+// rest of the renderer uses). Build scenes for BVH traversal additionally report the build time,
+// the number of build threads (RT_THREADS) and the SAH cost of the resulting tree. The same
+// scenes are built with each BVH builder: bvh_hit (median split), lbvh_hit and hlbvh_hit.
+// The *_occluded variants cast the same rays as any-hit visibility queries.
+//
+// Usage: RayTracingBench [--filter <substring>] [--max-primitives <n>] [--min-time <seconds>]
+
+#include "rt.h"
+
+#include "bvh.h"
+#include "cuboid.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "lbvh.h"
+#include "material.h"
+#include "perlin.h"
+#include "quad.h"
+#include "sphere.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr unsigned bench_seed = 1234;
+
+struct bench_options {
+    std::string filter;
+    size_t max_primitives = 1000000;
+    double min_time = 0.25;       // Seconds each benchmark is repeated for
+};
+
+// Keeps results alive so the optimizer cannot drop the work that produced them.
+volatile double sink;
+
+struct bench_result {
+    std::string name;
+    size_t iterations;
+    double seconds;
+    bool is_ray_cast;
+    std::string extra;            // Pre-formatted additional JSON fields
+};
+
+void print_result(const bench_result& result) {
+    auto ns_per_op = result.seconds * 1e9 / double(result.iterations);
+    auto ops_per_second = double(result.iterations) / result.seconds;
+
+    std::cout << "{\"name\": \"" << result.name << "\""
+              << ", \"iterations\": " << result.iterations
+              << ", \"ns_per_op\": " << ns_per_op
+              << ", \"ops_per_second\": " << ops_per_second;
+    if (result.is_ray_cast)
+        std::cout << ", \"rays_per_second\": " << ops_per_second;
+    std::cout << result.extra << "}" << std::endl;
+}
+
+// Runs `batch` (which performs `batch_size` operations) until min_time has elapsed, after one
+// untimed warm-up call.
+bench_result run(const std::string& name, const bench_options& options, size_t batch_size,
+                 bool is_ray_cast, const std::function<double()>& batch) {
+    sink = batch();
+
+    size_t iterations = 0;
+    double accum = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        accum += batch();
+        iterations += batch_size;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < options.min_time);
+    sink = accum;
+
+    return {name, iterations, elapsed.count(), is_ray_cast, ""};
+}
+
+bool selected(const bench_options& options, const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// Rays whose origins lie on a sphere of the given radius around the origin, aimed at random
+// points inside the target radius, so a good fraction of them hit the primitive under test.
+std::vector<ray> make_rays(size_t count, double origin_radius, double target_radius) {
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        auto origin = origin_radius * random_unit_vector();
+        auto target = target_radius * random_double() * random_unit_vector();
+        rays.emplace_back(origin, target - origin, random_double());
+    }
+    return rays;
+}
+
+double cast_all(const hittable& object, const std::vector<ray>& rays) {
+    hit_record rec;
+    double accum = 0;
+    for (const auto& r : rays)
+        if (object.hit(r, interval(0.001, infinity), rec))
+            accum += rec.t;
+    return accum;
+}
+
+double occlude_all(const hittable& object, const std::vector<ray>& rays) {
+    double accum = 0;
+    for (const auto& r : rays)
+        accum += object.occluded(r, interval(0.001, infinity));
+    return accum;
+}
+
+void bench_primitives(const bench_options& options) {
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    constexpr size_t ray_count = 1 << 16;
+
+    seed_random(bench_seed);
+    auto rays = make_rays(ray_count, 10.0, 1.5);
+
+    if (selected(options, "aabb_hit")) {
+        aabb box(point3(-1, -1, -1), point3(1, 1, 1));
+        print_result(run("aabb_hit", options, rays.size(), true, [&] {
+            double accum = 0;
+            for (const auto& r : rays)
+                accum += box.hit(r, interval(0.001, infinity));
+            return accum;
+        }));
+    }
+
+    std::vector<std::pair<std::string, shared_ptr<hittable>>> primitives = {
+        {"sphere_hit", make_shared<sphere>(point3(0, 0, 0), 1.0, mat)},
+        {"moving_sphere_hit", make_shared<moving_sphere>(point3(0, 0, 0), point3(0, 0.5, 0), 1.0, mat)},
+        {"quad_hit", make_shared<quad>(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), mat)},
+        {"axis_aligned_quad_hit", make_shared<axis_aligned_quad>(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), mat)},
+        {"disk_hit", make_shared<disk>(point3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), 1.0, mat)},
+        {"ellipse_hit", make_shared<ellipse>(point3(0, 0, 0), vec3(1, 0, 0), vec3(0, 0.5, 0), mat)},
+        {"box_hit", box(point3(-1, -1, -1), point3(1, 1, 1), mat)},
+        {"cuboid_hit", make_shared<cuboid>(point3(-1, -1, -1), point3(1, 1, 1), mat)},
+        {"rotated_box_hit", make_shared<rotate_y>(box(point3(-1, -1, -1), point3(1, 1, 1), mat), 30)},
+        {"rotated_cuboid_hit", cuboid::rotated_y(point3(-1, -1, -1), point3(1, 1, 1), mat, 30, vec3(0, 0, 0))},
+    };
+
+    for (const auto& [name, object] : primitives) {
+        if (!selected(options, name))
+            continue;
+        print_result(run(name, options, rays.size(), true, [&] {
+            return cast_all(*object, rays);
+        }));
+    }
+}
+
+void bench_bvh(const bench_options& options) {
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    constexpr size_t ray_count = 1 << 14;
+    const std::pair<const char*, bvh_builder> builders[] = {
+        {"bvh_", bvh_builder::median_split},
+        {"lbvh_", bvh_builder::lbvh},
+        {"hlbvh_", bvh_builder::hlbvh},
+    };
+
+    for (size_t count = 1000; count <= options.max_primitives; count *= 10) {
+        // Spheres scattered through a cube whose size grows with the count, keeping the
+        // density (and so the expected hit distance) roughly constant across sizes. Every
+        // builder sees the same scene and rays.
+        hittable_list list;
+        std::vector<ray> rays;
+        auto extent = std::cbrt(double(count));
+
+        for (const auto& [prefix, builder] : builders) {
+            auto name = prefix + std::string("hit_") + std::to_string(count);
+            auto occluded_name = prefix + std::string("occluded_") + std::to_string(count);
+            if (!selected(options, name) && !selected(options, occluded_name))
+                continue;
+
+            if (list.objects.empty()) {
+                seed_random(bench_seed);
+                for (size_t i = 0; i < count; i++)
+                    list.add(make_shared<sphere>(vec3::random(-extent, extent), 0.3, mat));
+                rays = make_rays(ray_count, 2 * extent, extent);
+            }
+
+            auto build_start = std::chrono::steady_clock::now();
+            auto tree = build_bvh(list, builder);
+            std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - build_start;
+
+            auto extra = ", \"primitives\": " + std::to_string(count)
+                       + ", \"build_seconds\": " + std::to_string(build_time.count())
+                       + ", \"build_threads\": " + std::to_string(thread_pool::global().size())
+                       + ", \"sah_cost\": " + std::to_string(tree->sah_cost());
+
+            if (selected(options, name)) {
+                auto result = run(name, options, rays.size(), true, [&] {
+                    return cast_all(*tree, rays);
+                });
+                result.extra = extra;
+                print_result(result);
+            }
+            if (selected(options, occluded_name)) {
+                auto result = run(occluded_name, options, rays.size(), true, [&] {
+                    return occlude_all(*tree, rays);
+                });
+                result.extra = extra;
+                print_result(result);
+            }
+        }
+    }
+}
+
+void bench_sampling(const bench_options& options) {
+    constexpr size_t batch = 1 << 16;
+    seed_random(bench_seed);
+
+    if (selected(options, "random_double")) {
+        print_result(run("random_double", options, batch, false, [] {
+            double accum = 0;
+            for (size_t i = 0; i < batch; i++)
+                accum += random_double();
+            return accum;
+        }));
+    }
+
+    if (selected(options, "random_unit_vector")) {
+        print_result(run("random_unit_vector", options, batch, false, [] {
+            double accum = 0;
+            for (size_t i = 0; i < batch; i++)
+                accum += random_unit_vector().x();
+            return accum;
+        }));
+    }
+
+    if (selected(options, "random_in_unit_disk")) {
+        print_result(run("random_in_unit_disk", options, batch, false, [] {
+            double accum = 0;
+            for (size_t i = 0; i < batch; i++)
+                accum += random_in_unit_disk().x();
+            return accum;
+        }));
+    }
+
+    if (selected(options, "random_on_hemisphere")) {
+        vec3 normal(0, 1, 0);
+        print_result(run("random_on_hemisphere", options, batch, false, [&] {
+            double accum = 0;
+            for (size_t i = 0; i < batch; i++)
+                accum += random_on_hemisphere(normal).y();
+            return accum;
+        }));
+    }
+
+    if (selected(options, "perlin_turb")) {
+        perlin noise;
+        std::vector<point3> points(batch);
+        for (auto& p : points)
+            p = vec3::random(-100, 100);
+
+        print_result(run("perlin_turb", options, batch, false, [&] {
+            double accum = 0;
+            for (const auto& p : points)
+                accum += noise.turb(p, 7);
+            return accum;
+        }));
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bench_options options;
+    for (int i = 1; i < argc; i++) {
+        auto has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--filter") && has_value)
+            options.filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--max-primitives") && has_value)
+            options.max_primitives = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--min-time") && has_value)
+            options.min_time = std::atof(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter <substring>] [--max-primitives <n>] [--min-time <seconds>]\n";
+            return 1;
+        }
+    }
+
+    bench_primitives(options);
+    bench_bvh(options);
+    bench_sampling(options);
+    return 0;
+}
@@ -0,0 +1,303 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "rt.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "environment.h"
+#include "framebuffer.h"
+#include "hittable_list.h"
+#include "light.h"
+#include "path_guide.h"
+#include "ray_sort.h"
+#include "sampler.h"
+#include "scene.h"
+
+#include <string>
+#include <vector>
+
+// End-to-end scene benchmark. Each scene is built and rendered from a fixed seed with
+// progressive passes (1, 1, 2, 4, ... samples per pixel) until the time budget would be
+// exceeded. After every pass the image is compared against a stored high-spp reference, which
+// gives an error-versus-time curve, so renderer versions are compared on quality per second
+// and not just on raw speed.
+//
+// References are PFM files named scene_NN.pfm in the reference directory. They are produced
+// by the same runner with reference_spp > 0.
+
+struct scene_bench_options {
+    std::vector<int> scenes;
+    double seconds_per_scene = 10.0;
+    unsigned seed = 42;
+    int image_width = 0;                // Overrides the scene's width when > 0
+    std::string reference_dir = "references";
+    int reference_spp = 0;              // When > 0, render and store references instead
+    std::vector<double> target_errors = {0.1, 0.05, 0.02, 0.01};  // relMSE targets
+    light_sampling lights = light_sampling::none;   // Light sampling of the renders
+    std::string environment;            // Environment map (see make_environment), if not empty
+    double environment_scale = 1;
+    bool guiding = false;               // Path guiding, trained after every pass
+    sampler_kind sampling = sampler_kind::independent;
+    bool denoise = false;               // Also measure the error of the denoised image after every pass
+};
+
+struct image_error {
+    double rmse;
+    double relmse;
+};
+
+// Root mean squared error and relative mean squared error, over all pixels and channels.
+// relMSE divides each squared error by the squared reference value (plus a small epsilon so
+// black pixels do not dominate), making it comparable between bright and dark scenes.
+inline image_error compare_images(const framebuffer& image, const framebuffer& reference) {
+    double squared = 0;
+    double relative = 0;
+    for (int j = 0; j < image.height; j++)
+        for (int i = 0; i < image.width; i++) {
+            auto x = image.pixel(i, j);
+            auto r = reference.pixel(i, j);
+            for (int c = 0; c < 3; c++) {
+                auto diff = x[c] - r[c];
+                squared  += diff * diff;
+                relative += diff * diff / (r[c] * r[c] + 1e-2);
+            }
+        }
+
+    auto n = 3.0 * image.width * image.height;
+    return {std::sqrt(squared / n), relative / n};
+}
+
+inline std::string reference_path(const scene_bench_options& options, int scene) {
+    auto number = std::to_string(scene);
+    if (number.size() < 2)
+        number = "0" + number;
+    return options.reference_dir + "/scene_" + number + ".pfm";
+}
+
+// Builds the scene from the fixed seed, collects its lights, wraps it in a BVH and seeds the
+// render with render_seed. Returns false if the scene is unknown.
+inline bool build_bench_scene(const scene_builder& build, const scene_bench_options& options,
+                              int scene, unsigned render_seed, scene_arena& arena,
+                              hittable_list& world, camera& cam) {
+    seed_random(options.seed);
+    if (!build(scene, arena, world, cam))
+        return false;
+    if (options.image_width > 0)
+        cam.image_width = options.image_width;
+
+    if (options.lights != light_sampling::none)
+        cam.lights = arena.make<light_set>(world, options.lights).get();
+    if (options.guiding)
+        cam.guide = arena.make<path_guide>(world.bounding_box()).get();
+    if (!options.environment.empty())
+        cam.environment = arena.make<environment_light>(make_environment(options.environment,
+                                                                         options.environment_scale)).get();
+    world = hittable_list(arena.make<bvh_node>(world, &arena));
+    cam.seed = render_seed;
+    cam.sampling = options.sampling;
+    return true;
+}
+
+// Renders reference_spp samples for every requested scene and stores the results.
+inline int make_references(const scene_builder& build, const scene_bench_options& options) {
+    for (int scene : options.scenes) {
+        scene_arena arena;
+        hittable_list world;
+        camera cam;
+        // The reference uses its own sample stream so its noise is not correlated with the
+        // benchmark renders it is compared against.
+        if (!build_bench_scene(build, options, scene, ~options.seed, arena, world, cam)) {
+            std::cerr << "Unknown scene " << scene << '\n';
+            return 1;
+        }
+
+        framebuffer fb;
+        constexpr int pass_spp = 16;
+        for (int done = 0; done < options.reference_spp; done += pass_spp) {
+            std::clog << "\rScene " << scene << ": " << done << "/" << options.reference_spp
+                      << " spp   " << std::flush;
+            cam.render_samples(world, fb, std::min(pass_spp, options.reference_spp - done));
+            if (cam.guide)
+                cam.guide->end_pass();
+        }
+
+        auto path = reference_path(options, scene);
+        if (!write_pfm(path, fb)) {
+            std::cerr << "\nError: could not write " << path << '\n';
+            return 1;
+        }
+        std::clog << "\rScene " << scene << ": wrote " << path << '\n';
+    }
+    return 0;
+}
+
+// Benchmarks every requested scene and writes a JSON array with one object per scene.
+inline int run_scene_benchmark(const scene_builder& build, const scene_bench_options& options,
+                               std::ostream& out) {
+    if (options.reference_spp > 0)
+        return make_references(build, options);
+
+    out << "[\n";
+    for (size_t s = 0; s < options.scenes.size(); s++) {
+        int scene = options.scenes[s];
+        scene_arena arena;
+        hittable_list world;
+        camera cam;
+        if (!build_bench_scene(build, options, scene, options.seed, arena, world, cam)) {
+            std::cerr << "Unknown scene " << scene << '\n';
+            return 1;
+        }
+
+        framebuffer reference;
+        bool has_reference = read_pfm(reference_path(options, scene), reference);
+
+        // With denoising, denoised is the error after filtering and denoise_seconds the time
+        // that took, on top of the features rendered once (aov_seconds).
+        struct curve_point { double seconds; int spp; image_error error; image_error denoised; double denoise_seconds; };
+        std::vector<curve_point> curve;
+
+        framebuffer fb;
+        aov_buffers aovs;
+        double aov_seconds = 0;
+        if (options.denoise) {
+            fb = cam.make_framebuffer();
+            fb.track_variance();
+            auto start = std::chrono::steady_clock::now();
+            aovs = cam.render_aovs(world);
+            aov_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::uint64_t rays = 0;
+        double elapsed = 0;
+        int pass_spp = 1;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            rays += cam.render_samples(world, fb, pass_spp);
+            if (cam.guide)
+                cam.guide->end_pass();
+            std::chrono::duration<double> pass_time = std::chrono::steady_clock::now() - start;
+            elapsed += pass_time.count();
+
+            if (has_reference && (reference.width != fb.width || reference.height != fb.height)) {
+                std::cerr << "Reference for scene " << scene << " has a different size; ignoring it\n";
+                has_reference = false;
+            }
+            curve.push_back({elapsed, fb.samples,
+                             has_reference ? compare_images(fb, reference) : image_error{0, 0}, {0, 0}, 0});
+            if (options.denoise) {
+                auto denoise_start = std::chrono::steady_clock::now();
+                auto denoised = denoise_image(fb, aovs, cam.denoising, cam.pool);
+                curve.back().denoise_seconds =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - denoise_start).count();
+                if (has_reference)
+                    curve.back().denoised = compare_images(denoised, reference);
+            }
+
+            // The next pass doubles the sample count (after the first two single-sample
+            // passes), so it is expected to take about twice as long as this one.
+            int next_spp = fb.samples < 2 ? 1 : fb.samples;
+            auto next_time = pass_time.count() * next_spp / pass_spp;
+            if (elapsed + next_time > options.seconds_per_scene)
+                break;
+            pass_spp = next_spp;
+        }
+
+        out << "  {\"scene\": " << scene
+            << ", \"width\": " << fb.width << ", \"height\": " << fb.height
+            << ", \"seed\": " << options.seed
+            << ", \"seconds\": " << elapsed
+            << ", \"spp\": " << fb.samples
+            << ", \"rays\": " << rays
+            << ", \"mrays_per_second\": " << double(rays) / elapsed / 1e6
+            << ", \"reference\": " << (has_reference ? "true" : "false");
+        if (options.denoise)
+            out << ", \"aov_seconds\": " << aov_seconds
+                << ", \"denoise_seconds\": " << curve.back().denoise_seconds;
+
+        if (has_reference) {
+            out << ", \"rmse\": " << curve.back().error.rmse
+                << ", \"relmse\": " << curve.back().error.relmse;
+
+            out << ",\n   \"curve\": [";
+            for (size_t i = 0; i < curve.size(); i++) {
+                out << (i ? ", " : "") << "{\"seconds\": " << curve[i].seconds
+                    << ", \"spp\": " << curve[i].spp
+                    << ", \"rmse\": " << curve[i].error.rmse
+                    << ", \"relmse\": " << curve[i].error.relmse;
+                if (options.denoise)
+                    out << ", \"denoised_relmse\": " << curve[i].denoised.relmse;
+                out << "}";
+            }
+            out << "]";
+
+            // Time at which each target error was first reached, or null if it never was. The
+            // denoised times include rendering the features and filtering.
+            auto time_to = [&](const char* name, bool denoised) {
+                out << ",\n   \"" << name << "\": {";
+                for (size_t t = 0; t < options.target_errors.size(); t++) {
+                    out << (t ? ", " : "") << "\"" << options.target_errors[t] << "\": ";
+                    auto reached = std::find_if(curve.begin(), curve.end(), [&](const curve_point& p) {
+                        return (denoised ? p.denoised : p.error).relmse <= options.target_errors[t];
+                    });
+                    if (reached == curve.end())
+                        out << "null";
+                    else
+                        out << reached->seconds + (denoised ? aov_seconds + reached->denoise_seconds : 0);
+                }
+                out << "}";
+            };
+            time_to("time_to_relmse", false);
+            if (options.denoise)
+                time_to("time_to_denoised_relmse", true);
+        }
+
+        out << "}" << (s + 1 < options.scenes.size() ? "," : "") << "\n" << std::flush;
+    }
+    out << "]\n";
+    return 0;
+}
+
+// Renders one scene with every ray_ordering and writes one JSON object per ordering. For the
+// breadth-first orderings it also reports secondary-ray throughput: rays of bounce one and
+// later per second of thread time spent sorting and tracing them.
+inline int run_ray_order_benchmark(const scene_builder& build, const scene_bench_options& options,
+                                   int scene, int samples, std::ostream& out) {
+    scene_arena arena;
+    hittable_list world;
+    camera cam;
+    if (!build_bench_scene(build, options, scene, options.seed, arena, world, cam)) {
+        std::cerr << "Unknown scene " << scene << '\n';
+        return 1;
+    }
+
+    secondary_ray_stats secondary;
+    cam.secondary_stats = &secondary;
+    for (auto ordering : {ray_ordering::depth_first, ray_ordering::breadth_first, ray_ordering::sorted}) {
+        cam.ordering = ordering;
+        secondary.clear();
+
+        framebuffer fb;
+        auto start = std::chrono::steady_clock::now();
+        auto rays = cam.render_samples(world, fb, samples);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        out << "{\"scene\": " << scene
+            << ", \"ordering\": \"" << ray_ordering_name(ordering) << "\""
+            << ", \"spp\": " << samples
+            << ", \"seconds\": " << elapsed.count()
+            << ", \"rays\": " << rays
+            << ", \"mrays_per_second\": " << double(rays) / elapsed.count() / 1e6;
+        if (ordering != ray_ordering::depth_first && secondary.nanoseconds > 0)
+            out << ", \"secondary_rays\": " << secondary.rays
+                << ", \"secondary_mrays_per_second\": "
+                << double(secondary.rays) / (double(secondary.nanoseconds) * 1e-9) / 1e6;
+        out << "}" << std::endl;
+    }
+    return 0;
+}
+
+#endif //BENCHMARK_H
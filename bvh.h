@@ -6,26 +6,36 @@
 #define BVH_H
 
 #include "aabb.h"
+#include "arena.h"
+#include "cuboid.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "quad.h"
+#include "sphere.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <bits/shared_ptr_base.h>
 
-class bvh_node : public hittable {
+class bvh_node final : public hittable {
 public:
-    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {
+    bvh_node(hittable_list list, scene_arena* arena = nullptr)
+        : bvh_node(list.objects, 0, list.objects.size(), arena) {
         // There's a C++ subtlety here. This constructor (without span indices) creates an
         // implicit copy of the hittable list, which we will modify. The lifetime of the copied
         // list only extends until this constructor exits. That's OK, because we only need to
         // persist the resulting bounding volume hierarchy.
     }
 
-    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+    // Builds the tree over objects[start, end), reordering that span. Spans larger than
+    // parallel_build_threshold build their two subtrees concurrently on the global thread pool
+    // and compute their bounds in parallel. The split rule does not depend on the number of
+    // threads, so the tree is the same however many threads build it. With an arena, the
+    // nodes are allocated from it.
+    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+             scene_arena* arena = nullptr) : hittable(hittable_kind::bvh_node) {
         // Build the bounding box of the span of source objects.
-        bbox = aabb::empty;
-        for (size_t object_index=start; object_index < end; object_index++)
-            bbox = aabb(bbox, objects[object_index]->bounding_box());
+        bbox = span_bounds(objects, start, end);
 
         int axis = bbox.longest_axis();
 
@@ -43,55 +53,216 @@ public:
             right = objects[start+1];
         }
         else {
-            std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
-
+            // Only the median split matters, not the order within each half: a partial
+            // selection gives the same halves as a full sort in linear rather than n log n time.
             auto mid = start + object_span/2;
-            left  = make_shared<bvh_node>(objects, start, mid);
-            right = make_shared<bvh_node>(objects, mid, end);
+            std::nth_element(std::begin(objects) + start, std::begin(objects) + mid,
+                             std::begin(objects) + end, comparator);
+
+            if (object_span >= parallel_build_threshold) {
+                // The halves are disjoint ranges of objects, so they can be built concurrently.
+                task_group group;
+                group.run([&] { left = make_object<bvh_node>(arena, objects, start, mid, arena); });
+                right = make_object<bvh_node>(arena, objects, mid, end, arena);
+                group.wait();
+            }
+            else {
+                left  = make_object<bvh_node>(arena, objects, start, mid, arena);
+                right = make_object<bvh_node>(arena, objects, mid, end, arena);
+            }
         }
 
         //  Use the below for random object selection
         // bbox = aabb(left->bounding_box(), right->bounding_box());
     }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    // Joins two existing subtrees (or primitives) under a new node. Used by builders that
+    // emit the hierarchy themselves, such as the LBVH builder.
+    bvh_node(shared_ptr<hittable> left, shared_ptr<hittable> right)
+        : hittable(hittable_kind::bvh_node), left(std::move(left)), right(std::move(right)) {
+        bbox = aabb(this->left->bounding_box(), this->right->bounding_box());
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const final {
+        RT_STAT_INC(bvh_nodes_visited);
         if (!bbox.hit(r, ray_t))
             return false;
-        bool hit_left =  left->hit(r, ray_t, rec);
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+        bool hit_left =  hit_child(*left, r, ray_t, rec);
+        bool hit_right = hit_child(*right, r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
 
         return hit_left || hit_right;
     }
 
+    // Any-hit traversal: stops at the first blocker instead of shrinking the interval.
+    bool occluded(const ray& r, interval ray_t) const final {
+        RT_STAT_INC(bvh_nodes_visited);
+        if (!bbox.hit(r, ray_t))
+            return false;
+        return occluded_child(*left, r, ray_t) || occluded_child(*right, r, ray_t);
+    }
+
+    // Like occluded(), but media inside the tree let part of the light through.
+    double transmittance(const ray& r, interval ray_t) const final {
+        RT_STAT_INC(bvh_nodes_visited);
+        if (!bbox.hit(r, ray_t))
+            return 1;
+        auto fraction = transmittance_child(*left, r, ray_t);
+        return fraction == 0 ? 0 : fraction * transmittance_child(*right, r, ray_t);
+    }
+
         aabb bounding_box() const override{ return bbox; }
 
+    // Keeps the tree topology and recomputes every box bottom-up from the (moved) objects.
+    // Much cheaper than a rebuild, but the tree gets worse as objects drift apart; watch
+    // sah_cost() to decide when a rebuild is due.
+    void refit() override {
+        left->refit();
+        if (right != left)
+            right->refit();
+        bbox = aabb(left->bounding_box(), right->bounding_box());
+    }
+
+    // Surface area heuristic cost of this subtree: the expected number of node visits and
+    // primitive tests for a random ray that hits this node's box. Only meaningful relative to
+    // the cost of another tree over the same objects.
+    double sah_cost() const {
+        constexpr double traversal_cost = 1.0;
+        constexpr double intersection_cost = 1.0;
+
+        auto area = bbox.surface_area();
+        auto cost = traversal_cost;
+        for (const auto& child : {left, right}) {
+            auto node = dynamic_cast<const bvh_node*>(child.get());
+            auto child_cost = node ? node->sah_cost() : intersection_cost;
+            cost += (area > 0 ? child->bounding_box().surface_area() / area : 1.0) * child_cost;
+            if (left == right)
+                break;
+        }
+        return cost;
+    }
+
 
 
+    // Spans at least this large are built with parallel subtrees; below it the task overhead
+    // outweighs the work.
+    static constexpr size_t parallel_build_threshold = 4096;
+
 private:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
     aabb bbox;
 
+    static bool hit_child(const hittable& child, const ray& r, interval ray_t, hit_record& rec);
+    static bool occluded_child(const hittable& child, const ray& r, interval ray_t);
+    static double transmittance_child(const hittable& child, const ray& r, interval ray_t);
+
+    static aabb span_bounds(const std::vector<shared_ptr<hittable>>& objects,
+                            size_t start, size_t end) {
+        constexpr size_t chunk = 16384;
+        if (end - start < 2 * chunk) {
+            auto box = aabb::empty;
+            for (size_t object_index=start; object_index < end; object_index++)
+                box = aabb(box, objects[object_index]->bounding_box());
+            return box;
+        }
+
+        // Near the root: reduce fixed-size chunks in parallel, then merge the partial boxes.
+        std::vector<aabb> partial((end - start + chunk - 1) / chunk, aabb::empty);
+        thread_pool::global().parallel_for(partial.size(), [&](size_t c) {
+            auto chunk_end = std::min(end, start + (c + 1) * chunk);
+            for (size_t object_index = start + c * chunk; object_index < chunk_end; object_index++)
+                partial[c] = aabb(partial[c], objects[object_index]->bounding_box());
+        });
+
+        auto box = aabb::empty;
+        for (const auto& p : partial)
+            box = aabb(box, p);
+        return box;
+    }
+
     static bool box_compare(
-        const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
+        const shared_ptr<hittable>& a, const shared_ptr<hittable>& b, int axis_index
         ) {
         auto a_axis_interval = a->bounding_box().axis_interval(axis_index);
         auto b_axis_interval = b->bounding_box().axis_interval(axis_index);
         return a_axis_interval.min < b_axis_interval.min;
     }
 
-    static bool box_compare_x(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_compare_x(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a,b,0);
     }
 
-    static bool box_compare_y(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_compare_y(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a,b,1);
     }
 
-    static bool box_compare_z(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_compare_z(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a,b,2);
     }
 
 };
 
+// Calls the child's hit() without a virtual call when it is one of the built-in primitives or
+// another node, so the compiler can inline the primitive tests into the traversal.
+inline bool bvh_node::hit_child(const hittable& child, const ray& r, interval ray_t,
+                                hit_record& rec) {
+    switch (child.kind()) {
+        case hittable_kind::bvh_node:
+            return static_cast<const bvh_node&>(child).bvh_node::hit(r, ray_t, rec);
+        case hittable_kind::sphere:
+            return static_cast<const sphere&>(child).sphere::hit(r, ray_t, rec);
+        case hittable_kind::moving_sphere:
+            return static_cast<const moving_sphere&>(child).moving_sphere::hit(r, ray_t, rec);
+        case hittable_kind::quad:
+            return static_cast<const quad&>(child).quad::hit(r, ray_t, rec);
+        case hittable_kind::axis_aligned_quad:
+            return static_cast<const axis_aligned_quad&>(child).axis_aligned_quad::hit(r, ray_t, rec);
+        case hittable_kind::disk:
+            return static_cast<const disk&>(child).disk::hit(r, ray_t, rec);
+        case hittable_kind::ellipse:
+            return static_cast<const ellipse&>(child).ellipse::hit(r, ray_t, rec);
+        case hittable_kind::cuboid:
+            return static_cast<const cuboid&>(child).cuboid::hit(r, ray_t, rec);
+        default:
+            return child.hit(r, ray_t, rec);
+    }
+}
+
+// The same closed-set dispatch for occluded().
+inline bool bvh_node::occluded_child(const hittable& child, const ray& r, interval ray_t) {
+    switch (child.kind()) {
+        case hittable_kind::bvh_node:
+            return static_cast<const bvh_node&>(child).bvh_node::occluded(r, ray_t);
+        case hittable_kind::sphere:
+            return static_cast<const sphere&>(child).sphere::occluded(r, ray_t);
+        case hittable_kind::moving_sphere:
+            return static_cast<const moving_sphere&>(child).moving_sphere::occluded(r, ray_t);
+        case hittable_kind::quad:
+            return static_cast<const quad&>(child).quad::occluded(r, ray_t);
+        case hittable_kind::axis_aligned_quad:
+            return static_cast<const axis_aligned_quad&>(child).axis_aligned_quad::occluded(r, ray_t);
+        case hittable_kind::disk:
+            return static_cast<const disk&>(child).disk::occluded(r, ray_t);
+        case hittable_kind::ellipse:
+            return static_cast<const ellipse&>(child).ellipse::occluded(r, ray_t);
+        case hittable_kind::cuboid:
+            return static_cast<const cuboid&>(child).cuboid::occluded(r, ray_t);
+        default:
+            return child.occluded(r, ray_t);
+    }
+}
+
+// Built-in primitives are opaque, so only nested nodes and other objects are asked for more
+// than occluded().
+inline double bvh_node::transmittance_child(const hittable& child, const ray& r, interval ray_t) {
+    switch (child.kind()) {
+        case hittable_kind::bvh_node:
+            return static_cast<const bvh_node&>(child).bvh_node::transmittance(r, ray_t);
+        case hittable_kind::other:
+            return child.transmittance(r, ray_t);
+        default:
+            return occluded_child(child, r, ray_t) ? 0 : 1;
+    }
+}
+
 #endif //BVH_H
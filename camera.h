@@ -5,9 +5,23 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "denoise.h"
+#include "environment.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "light.h"
 #include "material.h"
+#include "path_guide.h"
+#include "ray_sort.h"
 #include "rt.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "tiled_image.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
 
 class camera {
 public:
@@ -25,6 +39,22 @@ public:
     double defocus_angle = 0; // Variation angle of rays through each pixel
     double focus_dist = 10; // Distance between lookfrom and the plane of perfect focus
 
+    unsigned seed = 0; // Base seed of the per-tile sample streams
+    int tile_size = 32; // Edge length in pixels of the tiles rendered in parallel
+    thread_pool *pool = nullptr; // Pool that renders the tiles; null means the global pool
+
+    ray_ordering ordering = ray_ordering::depth_first; // How the bounces of a tile are traced
+    int ray_batch = 16384; // Paths traced together per tile in the breadth-first orderings
+    secondary_ray_stats *secondary_stats = nullptr; // Receives breadth-first bounce timings
+    const light_set *lights = nullptr; // Lights sampled at diffuse vertices; null means none
+    const environment_light *environment = nullptr; // Replaces background and is sampled at diffuse vertices
+    path_guide *guide = nullptr; // Learns incident light and guides diffuse scattering; trained between passes
+    sampler_kind sampling = sampler_kind::independent; // Where the random numbers of pixel samples come from
+    bool denoise = false; // render() filters the image with the AOV-guided denoiser before writing it
+    denoise_options denoising; // Settings of that filter
+    std::string aov_prefix; // If set, render() also writes PREFIX_albedo/normal/depth/variance.pfm
+    double time_budget = 0; // Seconds; when > 0, render() takes as many samples as fit, with the AOVs and denoising, instead of samples_per_pixel
+
     void render(const hittable &world) {
         initialize();
         std::ofstream img("./image.ppm");
@@ -37,21 +67,285 @@ public:
         std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
         img << "P3\n" << image_width << " " << image_height << "\n255\n";
 
-        for (int j = 0; j < image_height; ++j) {
-            std::cout << "\rScanLines remaining: " << image_height - j << "   " << std::flush;
-            for (int i = 0; i < image_width; ++i) {
-                color pixel_color = color(0, 0, 0);
-                for (int samples = 0; samples < samples_per_pixel; ++samples) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
+        auto start = std::chrono::steady_clock::now();
+        framebuffer fb(image_width, image_height);
+        auto features = denoise || !aov_prefix.empty();
+        if (features)
+            fb.track_variance();
+        aov_buffers aovs;
+        if (features) {
+            scoped_phase_timer timer("aovs");
+            aovs = render_aovs(world);
+        }
+        {
+            scoped_phase_timer timer("render");
+            if (time_budget > 0) {
+                // The AOVs and the filter come out of the budget too; the filter's time is
+                // estimated from a strip of the image.
+                auto filter_seconds = denoise ? estimate_denoise_seconds(aovs, denoising, pool) : 0.0;
+                auto spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                auto report = render_for(world, fb, time_budget - spent - filter_seconds, true);
+                std::clog << "\rTime budget " << time_budget << " s: " << report.samples << " spp in "
+                          << report.passes << " passes, " << report.seconds << " s, "
+                          << double(report.rays) / report.seconds / 1e6 << " Mrays/s\n";
+            }
+            else if (guide) {
+                // Passes of 1, 2, 4, ... samples; the guide learns from each before the next.
+                for (int done = 0, pass = 1; done < samples_per_pixel; done += pass, pass *= 2) {
+                    pass = std::min(pass, samples_per_pixel - done);
+                    render_samples(world, fb, pass, true);
+                    guide->end_pass();
                 }
-                write_color(img, pixel_samples_scale * pixel_color);
             }
+            else
+                render_samples(world, fb, samples_per_pixel, true);
         }
+        if (!aov_prefix.empty() && !write_aovs(aov_prefix, aovs, fb))
+            std::cerr << "Error: could not write the AOVs to " << aov_prefix << "_*.pfm\n";
+        if (denoise) {
+            scoped_phase_timer timer("denoise");
+            fb = denoise_image(fb, aovs, denoising, pool);
+        }
+
+        scoped_phase_timer timer("write");
+        pixel_samples_scale = 1.0 / fb.samples;
+        for (int j = 0; j < image_height; ++j)
+            for (int i = 0; i < image_width; ++i)
+                write_color(img, pixel_samples_scale * fb.at(i, j));
         std::clog << "\rDone!... Image Height in pixels is:  " << image_height << '\n';
         img.close();
     }
 
+    // Adds sample_count more samples to every pixel of fb, (re)allocating it if it does not
+    // match the image size, and returns the number of rays traced. Tiles are rendered in
+    // parallel on the camera's pool (the global one by default). Calling this repeatedly renders progressively; each
+    // pass draws fresh samples because the tile seeds include the samples already taken.
+    std::uint64_t render_samples(const hittable &world, framebuffer &fb, int sample_count,
+                                 bool show_progress = false) {
+        std::vector<camera*> views = {this};
+        std::vector<framebuffer*> targets = {&fb};
+        return render_views(world, views, targets, sample_count, show_progress);
+    }
+
+    // Renders samples first_sample .. first_sample + sample_count - 1 of every pixel into fb,
+    // which is cleared first and then holds only those samples. Renders of disjoint ranges can
+    // be added together (partial_render.h). Returns the number of rays traced.
+    std::uint64_t render_sample_range(const hittable &world, framebuffer &fb, int first_sample,
+                                      int sample_count, bool show_progress = false) {
+        initialize();
+        fb.reset(image_width, image_height);
+        fb.samples = first_sample;      // The tile seeds and samplers continue from here
+        auto rays = render_samples(world, fb, sample_count, show_progress);
+        fb.samples = sample_count;
+        return rays;
+    }
+
+    struct budget_report {
+        int samples = 0;            // Samples per pixel reached
+        int passes = 0;
+        double seconds = 0;         // Wall-clock time spent
+        std::uint64_t rays = 0;
+    };
+
+    // Adds progressive passes over all tiles to fb until the next one would not finish within
+    // `seconds` of wall-clock time, so the render ends before the deadline at whatever sample
+    // count fits. The first pass takes one sample; after that the time per sample of the latest
+    // pass sizes the next to what the remaining time allows, at most doubling the samples so
+    // far. At least one sample is always taken. The guide, if any, is trained after every pass.
+    budget_report render_for(const hittable &world, framebuffer &fb, double seconds, bool show_progress = false) {
+        budget_report report;
+        auto start = std::chrono::steady_clock::now();
+        int pass = 1;
+        while (true) {
+            auto pass_start = std::chrono::steady_clock::now();
+            report.rays += render_samples(world, fb, pass);
+            if (guide)
+                guide->end_pass();
+            auto now = std::chrono::steady_clock::now();
+            report.samples += pass;
+            report.passes++;
+            report.seconds = std::chrono::duration<double>(now - start).count();
+            if (show_progress)
+                std::cout << "\rPass " << report.passes << ": " << report.samples << " spp, "
+                          << report.seconds << " of " << seconds << " s   " << std::flush;
+
+            // The latest pass is the largest, so its rate is the best estimate of the next one's;
+            // 5% of the remaining time is kept back for the rate varying.
+            auto per_sample = std::chrono::duration<double>(now - pass_start).count() / pass;
+            auto fits = 0.95 * (seconds - report.seconds) / per_sample;
+            if (fits < 1)
+                break;
+            pass = int(std::min<double>(fits, report.samples));
+        }
+        return report;
+    }
+
+    // Renders the image tile by tile into a tiled image file (tiled_image.h). Each tile takes
+    // all its samples at once and goes to a writer thread, so only the tiles in flight are in
+    // memory, never the whole frame. The guide, if any, is not trained. Returns false if the
+    // file could not be written.
+    bool render_tiled(const hittable &world, const std::string &filename, bool show_progress = false) {
+        initialize();
+        auto tiles = make_tiles(image_width, image_height, tile_size);
+        auto &workers = pool ? *pool : thread_pool::global();
+        tiled_image_writer writer(filename, {image_width, image_height, tile_size, samples_per_pixel},
+                                  2 * workers.size());
+        if (!writer.is_open())
+            return false;
+
+        std::atomic<size_t> tiles_done{0};
+        std::mutex progress_mutex;
+        workers.parallel_for(tiles.size(), [&](size_t k) {
+            framebuffer local;
+            trace_tile(world, tiles[k], local, samples_per_pixel, 0);
+            writer.submit(tiles[k], std::move(local));
+
+            auto done = ++tiles_done;
+            if (show_progress) {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                std::cout << "\rTiles remaining: " << tiles.size() - done << "   " << std::flush;
+            }
+        });
+        return writer.finish();
+    }
+
+    // Renders several views of the same scene as one job: the tiles of all views are
+    // interleaved in a single queue, so the pool stays busy across view boundaries and the
+    // scene, BVH and textures are shared by every view. Each view adds sample_count samples to
+    // its framebuffer (or its own samples_per_pixel if sample_count is 0). The first view's pool
+    // renders all of them. Returns the total number of rays traced.
+    static std::uint64_t render_views(const hittable &world, const std::vector<camera*> &views,
+                                      const std::vector<framebuffer*> &targets,
+                                      int sample_count = 0, bool show_progress = false) {
+        struct view_tile { size_t view; tile t; };
+        std::vector<std::vector<tile>> per_view;
+        size_t longest = 0;
+
+        for (size_t v = 0; v < views.size(); v++) {
+            auto &cam = *views[v];
+            auto &fb = *targets[v];
+            cam.initialize();
+            if (fb.width != cam.image_width || fb.height != cam.image_height)
+                fb.reset(cam.image_width, cam.image_height);
+            per_view.push_back(make_tiles(cam.image_width, cam.image_height, cam.tile_size));
+            longest = std::max(longest, per_view.back().size());
+        }
+
+        // Round-robin over the views: tile 0 of every view, then tile 1 of every view, ...
+        std::vector<view_tile> work;
+        for (size_t k = 0; k < longest; k++)
+            for (size_t v = 0; v < views.size(); v++)
+                if (k < per_view[v].size())
+                    work.push_back({v, per_view[v][k]});
+
+        std::atomic<std::uint64_t> rays{0};
+        std::atomic<size_t> tiles_done{0};
+        std::mutex progress_mutex;
+
+        auto &workers = views.empty() || !views[0]->pool ? thread_pool::global() : *views[0]->pool;
+        workers.parallel_for(work.size(), [&](size_t index) {
+            const auto &[v, t] = work[index];
+            auto &cam = *views[v];
+            auto &fb = *targets[v];
+            auto count = sample_count > 0 ? sample_count : cam.samples_per_pixel;
+
+            framebuffer local(t.width(), t.height());
+            if (fb.tracks_variance())
+                local.track_variance();
+            rays += cam.trace_tile(world, t, local, count, fb.samples);
+
+            // Tiles never overlap, so each task owns its region of the framebuffer.
+            for (int j = 0; j < t.height(); ++j)
+                for (int i = 0; i < t.width(); ++i) {
+                    auto k = size_t(t.y0 + j) * fb.width + (t.x0 + i);
+                    fb.sum[k] += local.at(i, j);
+                    if (fb.tracks_variance())
+                        fb.sum_squares[k] += local.sum_squares[size_t(j) * local.width + i];
+                }
+
+            auto done = ++tiles_done;
+            if (show_progress) {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                std::cout << "\rTiles remaining: " << work.size() - done << "   " << std::flush;
+            }
+        });
+
+        for (size_t v = 0; v < views.size(); v++)
+            targets[v]->samples += sample_count > 0 ? sample_count : views[v]->samples_per_pixel;
+        return rays;
+    }
+
+    // The denoiser's features for every pixel, averaged over `samples` jittered camera rays:
+    // albedo, shading normal and distance of the first surface that is not glass or polished
+    // metal. Those are looked through, following one sampled reflection or refraction, so the
+    // features show what they reflect or let through. Rows are traced in parallel.
+    aov_buffers render_aovs(const hittable &world, int samples = 16) {
+        initialize();
+        aov_buffers aovs;
+        aovs.width = image_width;
+        aovs.height = image_height;
+        auto pixels = size_t(image_width) * image_height;
+        aovs.albedo.assign(pixels, color(0, 0, 0));
+        aovs.normal.assign(pixels, vec3(0, 0, 0));
+        aovs.depth.assign(pixels, 0);
+
+        auto &workers = pool ? *pool : thread_pool::global();
+        workers.parallel_for(size_t(image_height), [&](size_t row) {
+            auto j = int(row);
+            seed_random(seed ^ 0x5bd1e995u ^ (unsigned(j) * 2654435761u));
+            for (int i = 0; i < image_width; i++) {
+                auto k = size_t(j) * image_width + i;
+                vec3 normal_sum(0, 0, 0);
+                for (int s = 0; s < samples; s++) {
+                    auto r = get_ray(i, j);
+                    color throughput(1, 1, 1);
+                    double distance = 0;
+                    for (int bounce = 0; bounce < max_depth; bounce++) {
+                        hit_record rec;
+                        if (!world.hit(r, interval(0.001, infinity), rec))
+                            break;
+                        distance += rec.t * r.direction().length();
+                        auto kind = rec.mat->kind();
+                        auto specular = kind == material_kind::dielectric
+                            || (kind == material_kind::metal && static_cast<const metal &>(*rec.mat).roughness() < 0.3);
+                        ray scattered;
+                        color attenuation;
+                        if (specular && bounce + 1 < max_depth && scatter_ray(*rec.mat, r, rec, attenuation, scattered)) {
+                            throughput = throughput * attenuation;
+                            r = scattered;
+                            continue;
+                        }
+                        aovs.albedo[k] += throughput * surface_albedo(*rec.mat, rec) / samples;
+                        normal_sum += rec.normal;
+                        aovs.depth[k] += distance / samples;
+                        break;
+                    }
+                }
+                if (normal_sum.length_squared() > 0)
+                    aovs.normal[k] = unit_vector(normal_sum);
+            }
+        });
+        return aovs;
+    }
+
+    // Returns an empty framebuffer of this camera's image size.
+    framebuffer make_framebuffer() {
+        initialize();
+        return framebuffer(image_width, image_height);
+    }
+
+    // Adds sample_count samples to every pixel of tile t. out holds only the tile's pixels and
+    // is (re)allocated to the tile size if needed; it also sums squared samples if it tracks
+    // variance. The random stream is reseeded from the
+    // camera seed, the tile position and first_sample (the number of samples the tile already
+    // has), so a tile renders the same no matter which thread or process renders it. Returns
+    // the number of rays traced.
+    std::uint64_t render_tile(const hittable &world, const tile &t, framebuffer &out,
+                              int sample_count, int first_sample = 0) {
+        initialize();
+        return trace_tile(world, t, out, sample_count, first_sample);
+    }
+
 private:
     int image_height; // Rendered image height
     double pixel_samples_scale; // Color scale factor for sum of pixel samples
@@ -111,13 +405,183 @@ private:
         defocus_disk_v = v * defocus_radius;
     }
 
-    ray get_ray(int i, int j) {
+    // render_tile without initialize(), so concurrent tiles only read the camera.
+    std::uint64_t trace_tile(const hittable &world, const tile &t, framebuffer &out,
+                             int sample_count, int first_sample) const {
+        if (out.width != t.width() || out.height != t.height())
+            out.reset(t.width(), t.height());
+
+        seed_random(seed ^ (unsigned(t.y0) * 73856093u) ^ (unsigned(t.x0) * 19349663u)
+                         ^ (unsigned(first_sample) * 83492791u));
+        auto samples = make_sampler(sampling, first_sample, sample_count, seed);
+        sampler_scope scope(samples.get());
+
+        std::uint64_t rays = 0;
+        if (ordering == ray_ordering::depth_first) {
+            for (int j = t.y0; j < t.y1; ++j)
+                for (int i = t.x0; i < t.x1; ++i) {
+                    auto k = size_t(j - t.y0) * out.width + (i - t.x0);
+                    auto squares = out.tracks_variance() ? &out.sum_squares[k] : nullptr;
+                    out.sum[k] += render_pixel(world, i, j, sample_count, first_sample, *samples, rays, squares);
+                }
+        }
+        else {
+            // Batches of whole samples: every pixel of the tile gets the same number of paths.
+            auto pixels = t.width() * t.height();
+            auto batch_samples = std::max(1, ray_batch / pixels);
+            for (int first = 0; first < sample_count; first += batch_samples)
+                trace_batch(world, t, out, std::min(batch_samples, sample_count - first),
+                            first_sample + first, *samples, rays);
+        }
+        out.samples += sample_count;
+        return rays;
+    }
+
+    // One path being traced breadth-first.
+    struct path_state {
+        ray r;
+        color throughput;           // Product of the attenuations so far
+        color radiance;             // Light gathered so far
+        int pixel;                  // Index of the pixel within the tile
+        std::uint32_t sample;       // Index of the sample within the pixel
+        bool after_nee = false;     // The last vertex sampled a light directly
+        double scatter_pdf = 0;     // Density of r if the last vertex also sampled the environment
+    };
+
+    // Traces sample_count paths per pixel of tile t one bounce at a time: all camera rays, then
+    // all first bounces, and so on. The estimate is the same as ray_color's. With the sorted
+    // ordering every secondary bounce is traced in ray_sort_key order.
+    void trace_batch(const hittable &world, const tile &t, framebuffer &out, int sample_count,
+                     int first_sample, sampler &samples, std::uint64_t &rays) const {
+        std::vector<path_state> paths;
+        paths.reserve(size_t(t.width()) * t.height() * sample_count);
+        for (int j = t.y0; j < t.y1; ++j)
+            for (int i = t.x0; i < t.x1; ++i)
+                for (int s = 0; s < sample_count; ++s) {
+                    RT_STAT_INC(camera_rays);
+                    RT_STAT_INC(paths);
+                    auto index = std::uint32_t(first_sample + s);
+                    samples.start_pixel_sample(i, j, index);
+                    paths.push_back({get_ray(i, j), color(1, 1, 1), color(0, 0, 0),
+                                     (j - t.y0) * t.width() + (i - t.x0), index});
+                }
+
+        // Guided vertices, whose incident radiance is known once their path has ended.
+        struct guide_vertex {
+            std::uint32_t path;
+            path_guide::region *region;
+            vec3 direction;
+            double pdf;
+            color throughput;       // Path throughput after scattering at the vertex
+            color radiance;         // Path radiance gathered up to and at the vertex
+        };
+        std::vector<guide_vertex> guided;
+
+        std::vector<std::uint32_t> active(paths.size()), next;
+        for (size_t k = 0; k < active.size(); k++)
+            active[k] = std::uint32_t(k);
+        auto bounds = world.bounding_box();
+
+        for (int depth = 0; depth < max_depth && !active.empty(); depth++) {
+            auto start = std::chrono::steady_clock::now();
+            if (depth > 0 && ordering == ray_ordering::sorted)
+                sort_rays(active, bounds, [&](std::uint32_t k) -> const ray & { return paths[k].r; });
+
+            next.clear();
+            for (auto k : active) {
+                auto &path = paths[k];
+                // Paths are interleaved, so pick up this path's sample dimensions again.
+                samples.start_pixel_sample(t.x0 + path.pixel % t.width(), t.y0 + path.pixel / t.width(),
+                                           path.sample);
+                samples.start_bounce(depth);
+                hit_record rec;
+                rays++;
+                if (!world.hit(path.r, interval(0.001, infinity), rec)) {
+                    path.radiance += path.throughput * missed(path.r, path.scatter_pdf);
+                    continue;
+                }
+
+                RT_STAT_INC(path_vertices);
+                if (!path.after_nee || !counted_by_nee(rec))
+                    path.radiance += path.throughput * emitted_light(*rec.mat, rec.u, rec.v, rec.p);
+
+                ray scattered;
+                color attenuation;
+                if (!scatter_ray(*rec.mat, path.r, rec, attenuation, scattered))
+                    continue;
+
+                RT_STAT_INC(scatter_rays);
+                // Like ray_color, not on the last bounce, whose scattered ray is never traced.
+                auto last = depth + 1 == max_depth;
+                auto region = guided_region(rec);
+                path.after_nee = !last && samples_lights(rec);
+                if (path.after_nee)
+                    path.radiance += path.throughput * sample_light(world, path.r, rec, attenuation, rays);
+                auto sampled_environment = !last && samples_environment(rec);
+                if (sampled_environment)
+                    path.radiance += path.throughput * sample_environment(world, path.r, rec, attenuation,
+                                                                          region, rays);
+                double pdf = 0;
+                if (region && (pdf = guide_scatter(*region, rec, scattered, attenuation)) == 0)
+                    continue;
+                path.scatter_pdf = sampled_environment ? scatter_density(rec, region, scattered.direction()) : 0;
+                path.throughput = path.throughput * attenuation;
+                path.r = scattered;
+                if (region)
+                    guided.push_back({k, region, scattered.direction(), pdf, path.throughput, path.radiance});
+                next.push_back(k);
+            }
+
+            if (depth > 0 && secondary_stats) {
+                std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+                secondary_stats->rays += active.size();
+                secondary_stats->nanoseconds += std::uint64_t(elapsed.count());
+            }
+            active.swap(next);
+        }
+
+        // Radiance that arrived along a guided direction is everything the path gathered after
+        // the vertex, divided by the throughput it was gathered with.
+        for (const auto &vertex : guided) {
+            auto after = paths[vertex.path].radiance - vertex.radiance;
+            color incident;
+            for (int c = 0; c < 3; c++)
+                incident[c] = vertex.throughput[c] > 0 ? after[c] / vertex.throughput[c] : 0;
+            vertex.region->record(vertex.direction, luminance(incident), vertex.pdf);
+        }
+
+        for (const auto &path : paths) {
+            out.sum[size_t(path.pixel)] += path.radiance;
+            if (out.tracks_variance())
+                out.sum_squares[size_t(path.pixel)] += path.radiance * path.radiance;
+        }
+    }
+
+    // Returns the sum of sample_count samples for pixel i, j, counting traced rays into rays.
+    // first_sample is the index of the first of them within the pixel.
+    color render_pixel(const hittable &world, int i, int j, int sample_count, int first_sample,
+                       sampler &samples, std::uint64_t &rays, color *squares = nullptr) const {
+        color pixel_color = color(0, 0, 0);
+        for (int s = 0; s < sample_count; ++s) {
+            samples.start_pixel_sample(i, j, std::uint32_t(first_sample + s));
+            ray r = get_ray(i, j);
+            RT_STAT_INC(camera_rays);
+            RT_STAT_INC(paths);
+            auto sample = ray_color(r, max_depth, world, rays, false, 0);
+            pixel_color += sample;
+            if (squares)
+                *squares += sample * sample;
+        }
+        return pixel_color;
+    }
+
+    ray get_ray(int i, int j) const {
         // Construct a ray from defocus disk and directed at randomly sampled point
         // around the pixel location i, j
 
         auto offset = sample_square();
         auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u)
-                            + ((j + offset.x()) * pixel_delta_v);
+                            + ((j + offset.y()) * pixel_delta_v);
 
         auto ray_origin = (defocus_angle <= 0) ? camera_center : defocus_disk_sample();
         auto ray_direction = pixel_sample - ray_origin;
@@ -139,31 +603,193 @@ private:
         return camera_center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray &r, int depth, const hittable &world) {
+    // Diffuse surfaces and scattering points in media, whose direct lighting is sampled.
+    static bool diffuse_vertex(const hit_record &rec) {
+        return rec.mat->kind() == material_kind::lambertian || rec.mat->kind() == material_kind::isotropic;
+    }
+
+    // Light scattered toward the viewer per unit radiance arriving along wi at a diffuse vertex,
+    // before the albedo: cos / pi on a lambertian surface, the phase function 1 / (4 pi) in a
+    // medium.
+    static double diffuse_response(const hit_record &rec, const vec3 &wi) {
+        if (rec.mat->kind() == material_kind::isotropic)
+            return 1 / (4 * pi);
+        return std::fmax(0, dot(rec.normal, unit_vector(wi))) / pi;
+    }
+
+    // True if direct lighting at rec is estimated by sampling lights: diffuse vertices, when
+    // there are lights to sample.
+    bool samples_lights(const hit_record &rec) const {
+        return lights && !lights->empty() && diffuse_vertex(rec);
+    }
+
+    // True if rec is on one of the lights light_set samples, so its emission was already
+    // counted by sample_light at the previous vertex.
+    bool counted_by_nee(const hit_record &rec) const {
+        return lights && rec.object && lights->contains(rec.object);
+    }
+
+    // Next event estimation: light reaching the diffuse vertex rec directly from a point on one
+    // light picked by the light set, through any media in between.
+    color sample_light(const hittable &world, const ray &r_in, const hit_record &rec,
+                       const color &albedo, std::uint64_t &rays) const {
+        light_set::choice picked;
+        auto in_medium = rec.mat->kind() == material_kind::isotropic;
+        if (!lights->sample(rec.p, in_medium ? vec3(0, 0, 0) : rec.normal, picked))
+            return color(0, 0, 0);
+
+        auto s = picked.light->sample_surface(random_double(), random_double());
+        auto to_light = s.p - rec.p;
+        auto distance_squared = to_light.length_squared();
+        auto distance = std::sqrt(distance_squared);
+        auto wi = to_light / distance;
+        auto response = diffuse_response(rec, wi);
+        auto cos_light = std::fabs(dot(s.normal, wi));
+        if (response <= 0 || cos_light <= 0)
+            return color(0, 0, 0);
+
+        rays++;
+        RT_STAT_INC(shadow_rays);
+        auto visible = world.transmittance(ray(rec.p, wi, r_in.time()), interval(0.001, distance - 0.001));
+        if (visible == 0)
+            return color(0, 0, 0);
+
+        auto emitted = emitted_light(*picked.mat, s.u, s.v, s.p);
+        auto geometry = response * cos_light * picked.light->surface_area() / distance_squared;
+        return albedo * emitted * (visible * geometry / picked.pmf);
+    }
+
+    // True if rec samples the environment directly: diffuse vertices under an environment map.
+    bool samples_environment(const hit_record &rec) const {
+        return environment && diffuse_vertex(rec);
+    }
+
+    // The guide region of a diffuse vertex, or null if the vertex is not guided.
+    path_guide::region *guided_region(const hit_record &rec) const {
+        return guide && rec.mat->kind() == material_kind::lambertian ? &guide->region_at(rec.p) : nullptr;
+    }
+
+    // Solid-angle density of scattering from the diffuse vertex rec toward direction: uniform in
+    // a medium, else the cosine lobe, mixed with the learned distribution where region has one.
+    double scatter_density(const hit_record &rec, const path_guide::region *region,
+                           const vec3 &direction) const {
+        if (rec.mat->kind() == material_kind::isotropic)
+            return 1 / (4 * pi);
+        auto cosine_pdf = std::fmax(0, dot(rec.normal, unit_vector(direction))) / pi;
+        if (!region || !region->trained())
+            return cosine_pdf;
+        return (1 - guide->guide_fraction) * cosine_pdf + guide->guide_fraction * region->sampling.pdf(direction);
+    }
+
+    // Path guiding at a diffuse vertex: with probability guide_fraction the scattered direction
+    // is drawn from the region's learned distribution instead of the cosine lobe. Rewrites
+    // scattered, and attenuation (the albedo on entry), for the mixture of the two and returns
+    // its density, or 0 if the direction points into the surface.
+    double guide_scatter(const path_guide::region &region, const hit_record &rec, ray &scattered,
+                         color &attenuation) const {
+        if (region.trained() && random_double() < guide->guide_fraction) {
+            double unused;
+            auto direction = region.sampling.sample(random_double(), random_double(), unused);
+            scattered = ray(rec.p, direction, scattered.time());
+        }
+        auto cos_surface = dot(rec.normal, unit_vector(scattered.direction()));
+        auto pdf = scatter_density(rec, &region, scattered.direction());
+        if (cos_surface <= 0 || pdf <= 0)
+            return 0;
+        attenuation = attenuation * (cos_surface / (pi * pdf));
+        return pdf;
+    }
+
+    // Power heuristic weight of a strategy with density pdf against one with density other.
+    static double power_heuristic(double pdf, double other) {
+        return pdf * pdf / (pdf * pdf + other * other);
+    }
+
+    // Radiance of a ray that left the scene. scatter_pdf > 0 means the vertex it came from also
+    // sampled the environment, and the two estimates are combined by multiple importance sampling.
+    color missed(const ray &r, double scatter_pdf) const {
+        if (!environment)
+            return background;
+        auto radiance = environment->radiance(r.direction());
+        if (scatter_pdf > 0)
+            radiance = radiance * power_heuristic(scatter_pdf, environment->pdf(r.direction()));
+        return radiance;
+    }
+
+    // Next event estimation of the environment at the diffuse vertex rec, weighted against the
+    // scattering that could have picked the same direction.
+    color sample_environment(const hittable &world, const ray &r_in, const hit_record &rec,
+                             const color &albedo, const path_guide::region *region,
+                             std::uint64_t &rays) const {
+        vec3 wi;
+        color radiance;
+        double light_pdf;
+        if (!environment->sample(wi, radiance, light_pdf))
+            return color(0, 0, 0);
+        auto response = diffuse_response(rec, wi);
+        if (response <= 0)
+            return color(0, 0, 0);
+
+        rays++;
+        RT_STAT_INC(shadow_rays);
+        auto visible = world.transmittance(ray(rec.p, wi, r_in.time()), interval(0.001, infinity));
+        if (visible == 0)
+            return color(0, 0, 0);
+
+        auto scatter_pdf = scatter_density(rec, region, wi);
+        return albedo * radiance * (visible * response * power_heuristic(light_pdf, scatter_pdf) / light_pdf);
+    }
+
+    // after_nee: the previous vertex sampled a light, so light_set lights hit by r add nothing.
+    // scatter_pdf: density of r if the previous vertex also sampled the environment, else 0.
+    color ray_color(const ray &r, int depth, const hittable &world, std::uint64_t &rays,
+                    bool after_nee, double scatter_pdf) const {
         // If ray depth is exceeded no more light is gathered
         if (depth <= 0) {
             return color(0, 0, 0);
         }
 
+        start_sample_bounce(max_depth - depth);
         hit_record rec;
+        rays++;
 
         // If ray hits nothing then return the background color.
         if (!world.hit(r, interval(0.001, infinity), rec))
-            return background;
+            return missed(r, scatter_pdf);
+
+        RT_STAT_INC(path_vertices);
 
         ray scattered;
         color attenuation;
 
         // As of now this function only returns a
-        color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        color color_from_emission = after_nee && counted_by_nee(rec)
+                                    ? color(0, 0, 0) : emitted_light(*rec.mat, rec.u, rec.v, rec.p);
 
         // Base case, if the ray hits a light
-        if (!rec.mat->scatter(r, rec, attenuation, scattered))
+        if (!scatter_ray(*rec.mat, r, rec, attenuation, scattered))
             return color_from_emission;
 
-        color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
-
-        return color_from_emission + color_from_scatter;
+        RT_STAT_INC(scatter_rays);
+        // Not on the last bounce, where the scattered ray would gather nothing either.
+        auto region = guided_region(rec);
+        auto nee = depth > 1 && samples_lights(rec);
+        color color_from_lights = nee ? sample_light(world, r, rec, attenuation, rays) : color(0, 0, 0);
+        auto sampled_environment = depth > 1 && samples_environment(rec);
+        if (sampled_environment)
+            color_from_lights += sample_environment(world, r, rec, attenuation, region, rays);
+
+        double pdf = 0;
+        if (region && (pdf = guide_scatter(*region, rec, scattered, attenuation)) == 0)
+            return color_from_emission + color_from_lights;
+        double next_pdf = sampled_environment ? scatter_density(rec, region, scattered.direction()) : 0;
+
+        color incident = ray_color(scattered, depth-1, world, rays, nee, next_pdf);
+        if (region)
+            region->record(scattered.direction(), luminance(incident), pdf);
+        color color_from_scatter = attenuation * incident;
+
+        return color_from_emission + color_from_lights + color_from_scatter;
     }
 };
 
@@ -18,6 +18,11 @@ inline double linear_to_gamma(double linear_component) {
     return 0;
 }
 
+// Rec. 709 luminance of a linear colour.
+inline double luminance(const color& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 inline void write_color(std::ofstream& out, const color& pixel_color) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
@@ -0,0 +1,167 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef CUBOID_H
+#define CUBOID_H
+
+#include "arena.h"
+#include "hittable.h"
+
+// A solid box as a single primitive: one slab test instead of six quads behind a list, and
+// optionally an orientation and position in place of rotate_y/translate wrappers. The box spans
+// [lo, hi] in its own frame; a world point p has local coordinates dot(p - position, axis[i]).
+// Face normals and UVs are the same as those of the six quads box() in quad.h builds.
+class cuboid final : public hittable {
+public:
+    // Axis-aligned box with opposite corners a and b.
+    cuboid(const point3& a, const point3& b, shared_ptr<material> mat)
+        : cuboid(a, b, std::move(mat), vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), point3(0, 0, 0)) {}
+
+    // Box spanning a..b in a frame with orthonormal axes x, y, z whose origin is at position.
+    cuboid(const point3& a, const point3& b, shared_ptr<material> mat,
+           const vec3& x, const vec3& y, const vec3& z, const point3& position)
+        : hittable(hittable_kind::cuboid),
+          lo(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z())),
+          hi(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z())),
+          axis{x, y, z}, position(position), mat(std::move(mat)) {
+        oriented = x.x() != 1 || y.y() != 1 || z.z() != 1;
+        set_bounding_box();
+    }
+
+    // The box a..b rotated about the Y axis by angle degrees and then moved by offset, the same
+    // placement as translate(rotate_y(box(a, b), angle), offset).
+    static shared_ptr<cuboid> rotated_y(const point3& a, const point3& b, shared_ptr<material> mat,
+                                        double angle, const vec3& offset,
+                                        scene_arena* arena = nullptr) {
+        auto radians = degrees_to_radians(angle);
+        auto sin_theta = std::sin(radians);
+        auto cos_theta = std::cos(radians);
+        return make_object<cuboid>(arena, a, b, std::move(mat), vec3(cos_theta, 0, -sin_theta),
+                                   vec3(0, 1, 0), vec3(sin_theta, 0, cos_theta), offset);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const final {
+        RT_STAT_INC(primitive_tests);
+        auto local = to_local(r);
+        double t;
+        int face_axis;
+        bool entering;
+        if (!intersect(local, ray_t, t, face_axis, entering))
+            return false;
+
+        // The face hit is the max side of its slab when entering against, or leaving along, the
+        // direction of the ray on that axis.
+        auto d = local.direction()[face_axis];
+        bool max_side = entering ? d < 0 : d > 0;
+        vec3 outward(0, 0, 0);
+        outward[face_axis] = max_side ? 1 : -1;
+
+        rec.t = t;
+        rec.p = r.at(t);
+        set_face_uv(local.at(t), face_axis, max_side, rec);
+        rec.set_face_normal(r, to_world(outward));
+        rec.mat = mat;
+        rec.object = this;
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const final {
+        RT_STAT_INC(primitive_tests);
+        double t;
+        int face_axis;
+        bool entering;
+        return intersect(to_local(r), ray_t, t, face_axis, entering);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // Moves the box, for animation. The BVH above it must be refit afterwards.
+    void set_position(const point3& new_position) {
+        position = new_position;
+        set_bounding_box();
+    }
+
+private:
+    point3 lo, hi;
+    vec3 axis[3];               // World directions of the local x, y, z axes
+    point3 position;            // World position of the local origin
+    bool oriented;              // False when the axes are the world axes
+    shared_ptr<material> mat;
+    aabb bbox;
+
+    [[nodiscard]] ray to_local(const ray& r) const {
+        auto o = r.origin() - position;
+        if (!oriented)
+            return ray(o, r.direction(), r.time());
+        const auto& d = r.direction();
+        return ray(vec3(dot(o, axis[0]), dot(o, axis[1]), dot(o, axis[2])),
+                   vec3(dot(d, axis[0]), dot(d, axis[1]), dot(d, axis[2])), r.time());
+    }
+
+    [[nodiscard]] vec3 to_world(const vec3& v) const {
+        return oriented ? v.x() * axis[0] + v.y() * axis[1] + v.z() * axis[2] : v;
+    }
+
+    // Slab test in the local frame. Reports the entering face if it lies in ray_t, otherwise
+    // the leaving face (the ray starts inside the box).
+    bool intersect(const ray& r, interval ray_t, double& t, int& face_axis, bool& entering) const {
+        auto t_near = -infinity, t_far = infinity;
+        int near_axis = 0, far_axis = 0;
+        for (int a = 0; a < 3; a++) {
+            auto inverse = 1.0 / r.direction()[a];
+            auto t0 = (lo[a] - r.origin()[a]) * inverse;
+            auto t1 = (hi[a] - r.origin()[a]) * inverse;
+            if (t0 > t1)
+                std::swap(t0, t1);
+            if (t0 > t_near) { t_near = t0; near_axis = a; }
+            if (t1 < t_far)  { t_far = t1; far_axis = a; }
+        }
+        if (t_near > t_far)
+            return false;
+
+        if (ray_t.surrounds(t_near)) {
+            t = t_near;
+            face_axis = near_axis;
+            entering = true;
+            return true;
+        }
+        if (ray_t.surrounds(t_far)) {
+            t = t_far;
+            face_axis = far_axis;
+            entering = false;
+            return true;
+        }
+        return false;
+    }
+
+    // UVs of local point p on a face, oriented like the matching quad of box().
+    void set_face_uv(const point3& p, int face_axis, bool max_side, hit_record& rec) const {
+        auto size = hi - lo;
+        auto along = [&](int a) { return (p[a] - lo[a]) / size[a]; };
+        auto against = [&](int a) { return (hi[a] - p[a]) / size[a]; };
+        switch (face_axis) {
+            case 0:  rec.u = max_side ? against(2) : along(2); rec.v = along(1); break;
+            case 1:  rec.u = along(0); rec.v = max_side ? against(2) : along(2); break;
+            default: rec.u = max_side ? along(0) : against(0); rec.v = along(1); break;
+        }
+    }
+
+    void set_bounding_box() {
+        point3 min( infinity,  infinity,  infinity);
+        point3 max(-infinity, -infinity, -infinity);
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                for (int k = 0; k < 2; k++) {
+                    auto corner = position + to_world(vec3(i ? hi.x() : lo.x(), j ? hi.y() : lo.y(),
+                                                           k ? hi.z() : lo.z()));
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = std::fmin(min[c], corner[c]);
+                        max[c] = std::fmax(max[c], corner[c]);
+                    }
+                }
+        bbox = aabb(min, max);
+    }
+};
+
+#endif //CUBOID_H
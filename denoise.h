@@ -0,0 +1,328 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rt.h"
+
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Edge-avoiding a-trous wavelet denoising (Dammertz et al., with the variance-guided luminance
+// weights of Schied et al.'s SVGF). The image is divided by the albedo of the first surface, so
+// textures survive, then blurred by a 5x5 B3-spline kernel whose taps are spread 1, 2, 4, ...
+// pixels apart on successive passes. Each tap is weighted down where the shading normal, the
+// depth or the luminance differ, the last in units of the noise's standard deviation, so blurring
+// stops at geometric edges and at real detail while noise is averaged away.
+
+// Features of the first non-specular surface seen through every pixel, averaged over a few
+// camera rays (camera::render_aovs).
+struct aov_buffers {
+    int width = 0, height = 0;
+    std::vector<color> albedo;      // Black where the rays escape
+    std::vector<vec3> normal;       // Shading normal; zero where the rays escape
+    std::vector<double> depth;      // Distance travelled by the camera ray; zero where it escapes
+};
+
+struct denoise_options {
+    int iterations = 5;             // A-trous passes; the last has taps 2^(iterations-1) apart
+    double sigma_luminance = 4;     // Luminance edge stop, in standard deviations of the noise
+    double sigma_normal = 128;      // Power of the normals' cosine, rounded to a power of two
+    double sigma_depth = 1;         // Depth edge stop, relative to the local depth gradient
+};
+
+// e^-t for t >= 0, in float, written so that loops calling it vectorize: t is split into a whole
+// number of halvings, applied through the exponent bits, and a remainder within ln(2)/2 of zero,
+// whose exponential is a 6th order Taylor polynomial (relative error below 3e-7). Results under
+// e^-80 are rounded up to it.
+inline float exp_negative(float t) {
+    // Non-negative floats order like their bits, and an integer min keeps GCC from branching.
+    auto x = -std::bit_cast<float>(std::min(std::bit_cast<int>(t), std::bit_cast<int>(80.0f)));
+    // Adding 1.5 * 2^23 rounds to a whole number, left in the low bits of the mantissa.
+    auto shifted = x * 1.44269504f + 12582912.0f;
+    auto n = shifted - 12582912.0f;
+    auto z = x - n * 0.693145752f - n * 1.42860677e-6f;   // ln(2) in two parts, for precision
+    auto p = 1 + z * (1 + z * (1.0f / 2 + z * (1.0f / 6 + z * (1.0f / 24 + z * (1.0f / 120 + z * (1.0f / 720))))));
+    return p * std::bit_cast<float>((std::bit_cast<int>(shifted) - 0x4B400000 + 127) << 23);
+}
+
+// Planar inputs of one a-trous pass.
+struct atrous_planes {
+    const float *r, *g, *b, *variance;
+    const float *nx, *ny, *nz, *background;     // background is 1 where the camera rays escape
+    const float *depth, *depth_dx, *depth_dy;
+    const float *luminance, *luminance_scale;   // 1 / (sigma_luminance * standard deviation)
+};
+
+// Adds tap (x, y), with kernel weight kernel_weight and taps step pixels apart, to the sums of the
+// pixels [begin, end) of row j, for all of which the tap lies inside the image. normal_weight is
+// scratch space for one weight per pixel. The loops have no branches, so they vectorize.
+inline void add_atrous_tap(const atrous_planes& in, int width, int j, int begin, int end,
+                           int x, int y, int step, float kernel_weight, int normal_squarings, float sigma_depth,
+                           float* __restrict sum_r, float* __restrict sum_g, float* __restrict sum_b,
+                           float* __restrict sum_v, float* __restrict weights, float* __restrict normal_weight) {
+    const float* __restrict r = in.r;
+    const float* __restrict g = in.g;
+    const float* __restrict b = in.b;
+    const float* __restrict variance = in.variance;
+    const float* __restrict nx = in.nx;
+    const float* __restrict ny = in.ny;
+    const float* __restrict nz = in.nz;
+    const float* __restrict background = in.background;
+    const float* __restrict depth = in.depth;
+    const float* __restrict depth_dx = in.depth_dx;
+    const float* __restrict depth_dy = in.depth_dy;
+    const float* __restrict luminance = in.luminance;
+    const float* __restrict luminance_scale = in.luminance_scale;
+
+    auto row = ptrdiff_t(j) * width;
+    auto offset = ptrdiff_t(y) * step * width + ptrdiff_t(x) * step;
+
+    // The normals' cosine raised to 2^normal_squarings, one squaring per sweep. Background
+    // normals are zero, so background gets no weight from a surface and full weight from other
+    // background.
+    for (int i = begin; i < end; i++) {
+        auto p = row + i, q = p + offset;
+        normal_weight[i] = std::max(nx[p] * nx[q] + ny[p] * ny[q] + nz[p] * nz[q], 0.0f);
+    }
+    for (int k = 0; k < normal_squarings; k++)
+        for (int i = begin; i < end; i++)
+            normal_weight[i] *= normal_weight[i];
+
+    auto along_x = float(std::abs(x * step)), along_y = float(std::abs(y * step));
+    for (int i = begin; i < end; i++) {
+        auto p = row + i, q = p + offset;
+        auto w_n = normal_weight[i] + background[p] * background[q];
+        auto expected = depth_dx[p] * along_x + depth_dy[p] * along_y;
+        auto e_z = std::fabs(depth[p] - depth[q]) / (sigma_depth * expected + 1e-3f * depth[p] + 1e-6f);
+        auto e_l = std::fabs(luminance[p] - luminance[q]) * luminance_scale[p];
+        auto w = kernel_weight * w_n * exp_negative(e_z + e_l);
+        sum_r[i] += w * r[q];
+        sum_g[i] += w * g[q];
+        sum_b[i] += w * b[q];
+        sum_v[i] += w * w * variance[q];
+        weights[i] += w;
+    }
+}
+
+// The denoised image as a framebuffer with the same sample count as noisy. Pixel variance comes
+// from noisy's sums of squares if it tracks them, and is estimated from each pixel's 3x3
+// neighbourhood otherwise. Rows are filtered in parallel on pool.
+inline framebuffer denoise_image(const framebuffer& noisy, const aov_buffers& aovs,
+                                 const denoise_options& options = {}, thread_pool* pool = nullptr) {
+    auto width = noisy.width, height = noisy.height;
+    auto pixels = size_t(width) * height;
+    auto& workers = pool ? *pool : thread_pool::global();
+    auto rows = [&](auto&& body) { workers.parallel_for(size_t(height), [&](size_t j) { body(int(j)); }); };
+
+    // Planar float buffers: the passes below stream through them row by row.
+    std::vector<float> r(pixels), g(pixels), b(pixels), variance(pixels);
+    std::vector<float> nx(pixels), ny(pixels), nz(pixels), background(pixels);
+    std::vector<float> depth(pixels), depth_dx(pixels), depth_dy(pixels);
+    std::vector<color> modulation(pixels);
+
+    // Demodulate by albedo; channels with almost no albedo keep their radiance.
+    rows([&](int j) {
+        for (int i = 0; i < width; i++) {
+            auto k = size_t(j) * width + i;
+            auto a = aovs.albedo[k];
+            auto m = color(a.x() > 0.01 ? a.x() : 1, a.y() > 0.01 ? a.y() : 1, a.z() > 0.01 ? a.z() : 1);
+            auto inverse = color(1 / m.x(), 1 / m.y(), 1 / m.z());
+            auto c = noisy.pixel(i, j) * inverse;
+            modulation[k] = m;
+            r[k] = float(c.x());
+            g[k] = float(c.y());
+            b[k] = float(c.z());
+            if (noisy.tracks_variance() && noisy.samples > 0) {
+                auto v = noisy.variance(i, j) / noisy.samples * inverse * inverse;
+                variance[k] = float(0.2126 * 0.2126 * v.x() + 0.7152 * 0.7152 * v.y() + 0.0722 * 0.0722 * v.z());
+            }
+            nx[k] = float(aovs.normal[k].x());
+            ny[k] = float(aovs.normal[k].y());
+            nz[k] = float(aovs.normal[k].z());
+            background[k] = nx[k] == 0 && ny[k] == 0 && nz[k] == 0 ? 1.0f : 0.0f;
+            depth[k] = float(aovs.depth[k]);
+        }
+    });
+
+    auto lum = [&](size_t k) { return 0.2126f * r[k] + 0.7152f * g[k] + 0.0722f * b[k]; };
+    if (!noisy.tracks_variance()) {
+        rows([&](int j) {
+            for (int i = 0; i < width; i++) {
+                float sum = 0, squares = 0;
+                int count = 0;
+                for (int y = std::max(j - 1, 0); y <= std::min(j + 1, height - 1); y++)
+                    for (int x = std::max(i - 1, 0); x <= std::min(i + 1, width - 1); x++) {
+                        auto l = lum(size_t(y) * width + x);
+                        sum += l;
+                        squares += l * l;
+                        count++;
+                    }
+                auto mean = sum / count;
+                variance[size_t(j) * width + i] = std::max(squares / count - mean * mean, 0.0f);
+            }
+        });
+    }
+
+    // Depth gradients, one-sided toward the closer neighbour so they do not reach across edges.
+    rows([&](int j) {
+        for (int i = 0; i < width; i++) {
+            auto k = size_t(j) * width + i;
+            auto slope = [&](int step, bool has_before, bool has_after) {
+                auto before = has_before ? std::fabs(depth[k] - depth[k - size_t(step)]) : INFINITY;
+                auto after = has_after ? std::fabs(depth[k + size_t(step)] - depth[k]) : INFINITY;
+                auto s = std::min(before, after);
+                return std::isfinite(s) ? s : 0.0f;
+            };
+            depth_dx[k] = slope(1, i > 0, i + 1 < width);
+            depth_dy[k] = slope(width, j > 0, j + 1 < height);
+        }
+    });
+
+    const float kernel[3] = {3.0f / 8, 1.0f / 4, 1.0f / 16};
+    std::vector<float> r_out(pixels), g_out(pixels), b_out(pixels), variance_out(pixels);
+    std::vector<float> luminance(pixels), luminance_scale(pixels);
+    auto sigma_l = float(options.sigma_luminance);
+    auto sigma_z = float(options.sigma_depth);
+    // The normals' power is rounded to a power of two, 2^normal_squarings, up to 256.
+    auto normal_squarings = std::clamp(int(std::lround(std::log2(std::max(options.sigma_normal, 1.0)))), 0, 8);
+
+    for (int pass = 0; pass < options.iterations; pass++) {
+        auto step = 1 << pass;
+
+        // The luminance weights use the variance blurred by a 3x3 Gaussian, which is steadier.
+        rows([&](int j) {
+            for (int i = 0; i < width; i++) {
+                float sum = 0, weights = 0;
+                for (int y = -1; y <= 1; y++)
+                    for (int x = -1; x <= 1; x++) {
+                        int qi = i + x, qj = j + y;
+                        if (qi < 0 || qi >= width || qj < 0 || qj >= height)
+                            continue;
+                        auto w = (x == 0 ? 0.5f : 0.25f) * (y == 0 ? 0.5f : 0.25f);
+                        sum += w * variance[size_t(qj) * width + qi];
+                        weights += w;
+                    }
+                auto k = size_t(j) * width + i;
+                luminance[k] = lum(k);
+                luminance_scale[k] = 1 / (sigma_l * std::sqrt(sum / weights) + 1e-6f);
+            }
+        });
+
+        atrous_planes planes{r.data(), g.data(), b.data(), variance.data(), nx.data(), ny.data(), nz.data(),
+                             background.data(), depth.data(), depth_dx.data(), depth_dy.data(),
+                             luminance.data(), luminance_scale.data()};
+        rows([&](int j) {
+            // The row's sums start from the centre tap, then gather the other taps one at a time,
+            // each over the pixels it does not take outside the image.
+            std::vector<float> sums(size_t(width) * 6);
+            auto sum_r = sums.data(), sum_g = sum_r + width, sum_b = sum_g + width;
+            auto sum_v = sum_b + width, weights = sum_v + width, normal_weight = weights + width;
+            auto row = size_t(j) * width;
+            auto centre = kernel[0] * kernel[0];
+            for (int i = 0; i < width; i++) {
+                sum_r[i] = centre * r[row + i];
+                sum_g[i] = centre * g[row + i];
+                sum_b[i] = centre * b[row + i];
+                sum_v[i] = centre * centre * variance[row + i];
+                weights[i] = centre;
+            }
+            for (int y = -2; y <= 2; y++) {
+                int qj = j + y * step;
+                if (qj < 0 || qj >= height)
+                    continue;
+                for (int x = -2; x <= 2; x++) {
+                    if (x == 0 && y == 0)
+                        continue;
+                    auto begin = std::max(-x * step, 0), end = std::min(width - x * step, width);
+                    add_atrous_tap(planes, width, j, begin, end, x, y, step,
+                                   kernel[std::abs(x)] * kernel[std::abs(y)], normal_squarings, sigma_z,
+                                   sum_r, sum_g, sum_b, sum_v, weights, normal_weight);
+                }
+            }
+            for (int i = 0; i < width; i++) {
+                r_out[row + i] = sum_r[i] / weights[i];
+                g_out[row + i] = sum_g[i] / weights[i];
+                b_out[row + i] = sum_b[i] / weights[i];
+                variance_out[row + i] = sum_v[i] / (weights[i] * weights[i]);
+            }
+        });
+        r.swap(r_out);
+        g.swap(g_out);
+        b.swap(b_out);
+        variance.swap(variance_out);
+    }
+
+    framebuffer result(width, height);
+    result.samples = std::max(noisy.samples, 1);
+    rows([&](int j) {
+        for (int i = 0; i < width; i++) {
+            auto k = size_t(j) * width + i;
+            result.sum[k] = color(r[k], g[k], b[k]) * modulation[k] * result.samples;
+        }
+    });
+    return result;
+}
+
+// Tap evaluations of the a-trous passes on a width x height image, which take most of the
+// filter's time. Taps outside the image are skipped, so short images make fewer per pixel.
+inline double atrous_tap_count(int width, int height, int iterations) {
+    double taps = 0;
+    for (int pass = 0; pass < iterations; pass++)
+        for (int y = -2; y <= 2; y++)
+            for (int x = -2; x <= 2; x++)
+                taps += double(std::max(width - std::abs(x << pass), 0)) * std::max(height - std::abs(y << pass), 0);
+    return taps;
+}
+
+// Estimates the seconds denoise_image takes on the image aovs describe. The filter's cost does
+// not depend on the pixel values, so a strip of the top rows is filtered and the time scaled by
+// the tap counts of the strip and the whole image.
+inline double estimate_denoise_seconds(const aov_buffers& aovs, const denoise_options& options = {},
+                                       thread_pool* pool = nullptr) {
+    auto rows = std::min(aovs.height, 32);
+    auto pixels = size_t(aovs.width) * rows;
+    aov_buffers strip{aovs.width, rows,
+                      {aovs.albedo.begin(), aovs.albedo.begin() + ptrdiff_t(pixels)},
+                      {aovs.normal.begin(), aovs.normal.begin() + ptrdiff_t(pixels)},
+                      {aovs.depth.begin(), aovs.depth.begin() + ptrdiff_t(pixels)}};
+    framebuffer image(aovs.width, rows);
+    image.track_variance();
+
+    auto start = std::chrono::steady_clock::now();
+    denoise_image(image, strip, options, pool);
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * atrous_tap_count(aovs.width, aovs.height, options.iterations)
+                   / atrous_tap_count(aovs.width, rows, options.iterations);
+}
+
+// Writes the features and the variance of the pixel estimates of image as PFMs named
+// prefix_albedo.pfm, prefix_normal.pfm, prefix_depth.pfm and prefix_variance.pfm.
+inline bool write_aovs(const std::string& prefix, const aov_buffers& aovs, const framebuffer& image) {
+    framebuffer albedo(aovs.width, aovs.height), normal(aovs.width, aovs.height);
+    framebuffer depth(aovs.width, aovs.height), variance(aovs.width, aovs.height);
+    albedo.samples = normal.samples = depth.samples = variance.samples = 1;
+    for (int j = 0; j < aovs.height; j++)
+        for (int i = 0; i < aovs.width; i++) {
+            auto k = size_t(j) * aovs.width + i;
+            albedo.sum[k] = aovs.albedo[k];
+            normal.sum[k] = aovs.normal[k];
+            depth.sum[k] = color(aovs.depth[k], aovs.depth[k], aovs.depth[k]);
+            if (image.samples > 0)
+                variance.sum[k] = image.variance(i, j) / image.samples;
+        }
+    return write_pfm(prefix + "_albedo.pfm", albedo) && write_pfm(prefix + "_normal.pfm", normal)
+        && write_pfm(prefix + "_depth.pfm", depth) && write_pfm(prefix + "_variance.pfm", variance);
+}
+
+#endif //DENOISE_H
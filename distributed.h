@@ -0,0 +1,429 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rt.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "framebuffer.h"
+#include "hittable_list.h"
+#include "net.h"
+#include "scene.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if RT_HAS_SOCKETS
+    #include <spawn.h>
+    #include <sys/wait.h>
+    extern char** environ;
+#endif
+
+// Distributed tile rendering.
+//
+// The coordinator splits the image into tiles and serves them to worker processes over TCP.
+// Workers build the scene themselves from the scene number the coordinator sends them, so only
+// tile rectangles and pixel sums cross the network. When a worker disconnects or does not
+// answer within the tile timeout, its tile goes back into the queue for another worker; a tile
+// that fails max_attempts times aborts the render.
+//
+// Protocol (every message is a message_header followed by `size` payload bytes, host byte
+// order, so all processes must run on the same architecture):
+//   worker      -> coordinator  hello   protocol_magic
+//   coordinator -> worker       job     job_config
+//   coordinator -> worker       tile    tile_request
+//   worker      -> coordinator  result  tile_index, then width*height*3 floats of radiance sums
+//   coordinator -> worker       done    (no payload)
+
+struct distributed_options {
+    std::string host = "127.0.0.1";     // Coordinator address, for workers
+    int port = 5555;
+    int scene = 10;
+    unsigned seed = 42;
+    int image_width = 0;                // Overrides the scene's width when > 0
+    int tile_size = 32;
+    double tile_timeout = 300;          // Seconds a worker may spend on one tile
+    double idle_timeout = 60;           // Seconds to wait with tiles pending but no workers
+    int max_attempts = 3;               // Failures allowed per tile before giving up
+    int spawn_workers = 0;              // Local worker processes the coordinator starts itself
+    std::string program;                // Path of this executable, for spawning workers
+};
+
+namespace distributed {
+
+constexpr std::uint32_t protocol_magic = 0x52545731;   // "RTW1"
+
+enum class message_type : std::uint32_t { hello = 1, job = 2, tile = 3, result = 4, done = 5 };
+
+struct message_header {
+    std::uint32_t type;
+    std::uint32_t size;
+};
+
+struct job_config {
+    std::int32_t scene;
+    std::int32_t image_width;
+    std::uint32_t seed;
+};
+
+struct tile_request {
+    std::int32_t index;
+    std::int32_t x0, y0, x1, y1;
+};
+
+inline bool send_message(socket_connection& connection, message_type type,
+                         const void* payload, size_t size) {
+    message_header header{std::uint32_t(type), std::uint32_t(size)};
+    return connection.send_all(&header, sizeof(header)) &&
+           (size == 0 || connection.send_all(payload, size));
+}
+
+inline bool receive_message(socket_connection& connection, message_header& header,
+                            std::vector<char>& payload) {
+    if (!connection.receive_all(&header, sizeof(header)))
+        return false;
+    payload.resize(header.size);
+    return header.size == 0 || connection.receive_all(payload.data(), header.size);
+}
+
+// Builds the scene the same way on every process: fixed seed for any randomness in the scene
+// description, then a BVH over it.
+inline bool build_scene(const scene_builder& build, const job_config& job,
+                        scene_arena& arena, hittable_list& world, camera& cam) {
+    seed_random(job.seed);
+    if (!build(job.scene, arena, world, cam))
+        return false;
+    if (job.image_width > 0)
+        cam.image_width = job.image_width;
+    cam.seed = job.seed;
+    world = hittable_list(arena.make<bvh_node>(world, &arena));
+    return true;
+}
+
+// Shared state of a coordinator: the tile queue and the framebuffer being assembled.
+class tile_queue {
+public:
+    tile_queue(std::vector<tile> tiles, int max_attempts)
+        : tiles(std::move(tiles)), attempts(this->tiles.size(), 0), done(this->tiles.size(), false),
+          max_attempts(max_attempts) {
+        for (size_t i = 0; i < this->tiles.size(); i++)
+            pending.push_back(int(i));
+        remaining = this->tiles.size();
+    }
+
+    // Blocks until a tile is available or the render is over. Returns -1 when there is nothing
+    // left to hand out, or once the render has failed.
+    int acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !pending.empty() || remaining == 0 || failed; });
+        if (failed || pending.empty())
+            return -1;
+        int index = pending.front();
+        pending.pop_front();
+        return index;
+    }
+
+    // Marks a handed-out tile as done. A tile completed twice counts once.
+    void complete(int index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (done[index])
+            return;
+        done[index] = true;
+        remaining--;
+        changed.notify_all();
+    }
+
+    // Puts a tile back after a worker failed on it.
+    void retry(int index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++attempts[index] >= max_attempts)
+            failed = true;
+        else
+            pending.push_front(index);
+        changed.notify_all();
+    }
+
+    void worker_started() {
+        std::lock_guard<std::mutex> lock(mutex);
+        active_workers++;
+    }
+
+    void worker_finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        active_workers--;
+        changed.notify_all();
+    }
+
+    [[nodiscard]] bool finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return remaining == 0 || failed;
+    }
+
+    [[nodiscard]] bool has_failed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failed;
+    }
+
+    [[nodiscard]] int workers() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return active_workers;
+    }
+
+    [[nodiscard]] const tile& at(int index) const { return tiles[index]; }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+        changed.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<tile> tiles;
+    std::deque<int> pending;
+    std::vector<int> attempts;
+    std::vector<bool> done;
+    size_t remaining;
+    int max_attempts;
+    int active_workers = 0;
+    bool failed = false;
+};
+
+// Talks to one connected worker until the render is over or the worker fails.
+inline void serve_worker(socket_connection connection, const distributed_options& options,
+                         const job_config& job, tile_queue& queue, framebuffer& fb,
+                         std::mutex& fb_mutex) {
+    message_header header{};
+    std::vector<char> payload;
+
+    connection.set_receive_timeout(options.tile_timeout);
+    if (!receive_message(connection, header, payload) ||
+        header.type != std::uint32_t(message_type::hello) || header.size != sizeof(protocol_magic) ||
+        *reinterpret_cast<const std::uint32_t*>(payload.data()) != protocol_magic) {
+        std::clog << "Rejected a connection that is not a worker\n";
+        return;
+    }
+    if (!send_message(connection, message_type::job, &job, sizeof(job)))
+        return;
+
+    queue.worker_started();
+    while (true) {
+        int index = queue.acquire();
+        if (index < 0) {
+            send_message(connection, message_type::done, nullptr, 0);
+            break;
+        }
+
+        const auto& t = queue.at(index);
+        tile_request request{index, t.x0, t.y0, t.x1, t.y1};
+        auto expected = sizeof(std::int32_t) + size_t(t.width()) * t.height() * 3 * sizeof(float);
+
+        if (!send_message(connection, message_type::tile, &request, sizeof(request)) ||
+            !receive_message(connection, header, payload) ||
+            header.type != std::uint32_t(message_type::result) || header.size != expected ||
+            *reinterpret_cast<const std::int32_t*>(payload.data()) != index) {
+            std::clog << "Worker failed on tile " << index << ", requeueing it\n";
+            queue.retry(index);
+            break;
+        }
+
+        auto* sums = reinterpret_cast<const float*>(payload.data() + sizeof(std::int32_t));
+        {
+            std::lock_guard<std::mutex> lock(fb_mutex);
+            for (int j = 0; j < t.height(); j++)
+                for (int i = 0; i < t.width(); i++) {
+                    const float* s = sums + 3 * (size_t(j) * t.width() + i);
+                    fb.at(t.x0 + i, t.y0 + j) = color(s[0], s[1], s[2]);
+                }
+        }
+        queue.complete(index);
+    }
+    queue.worker_finished();
+}
+
+#if RT_HAS_SOCKETS
+// Starts `count` local worker processes pointed at this coordinator.
+inline std::vector<pid_t> spawn_local_workers(const distributed_options& options) {
+    std::vector<pid_t> children;
+    auto address = "127.0.0.1:" + std::to_string(options.port);
+    for (int w = 0; w < options.spawn_workers; w++) {
+        std::string program = options.program;
+        std::string flag = "--worker";
+        char* args[] = {program.data(), flag.data(), address.data(), nullptr};
+        pid_t pid;
+        if (posix_spawn(&pid, program.c_str(), nullptr, nullptr, args, environ) == 0)
+            children.push_back(pid);
+        else
+            std::cerr << "Could not start a local worker from " << program << '\n';
+    }
+    return children;
+}
+#endif
+
+} // namespace distributed
+
+// Runs the coordinator: serves tiles to workers until the image is complete, then writes it to
+// image.ppm. Returns the process exit code.
+inline int run_coordinator(const scene_builder& build, const distributed_options& options) {
+#if !RT_HAS_SOCKETS
+    std::cerr << "Distributed rendering is not supported on this platform\n";
+    return 1;
+#else
+    using namespace distributed;
+
+    // The coordinator needs the camera settings (image size, samples) but not the geometry.
+    scene_arena arena;
+    hittable_list world;
+    camera cam;
+    seed_random(options.seed);
+    if (!build(options.scene, arena, world, cam)) {
+        std::cerr << "Unknown scene " << options.scene << '\n';
+        return 1;
+    }
+    if (options.image_width > 0)
+        cam.image_width = options.image_width;
+
+    auto fb = cam.make_framebuffer();
+    fb.samples = cam.samples_per_pixel;
+    tile_queue queue(make_tiles(fb.width, fb.height, options.tile_size), options.max_attempts);
+    job_config job{options.scene, options.image_width, options.seed};
+
+    socket_listener listener(options.port);
+    if (!listener.valid()) {
+        std::cerr << "Error: could not listen on port " << options.port << '\n';
+        return 1;
+    }
+    std::clog << "Coordinator listening on port " << options.port << " for "
+              << fb.width << "x" << fb.height << " (" << options.tile_size << "px tiles)\n";
+
+    auto children = spawn_local_workers(options);
+    auto start_time = std::chrono::steady_clock::now();
+
+    std::mutex fb_mutex;
+    std::vector<std::thread> connections;
+    auto last_activity = std::chrono::steady_clock::now();
+    while (!queue.finished()) {
+        auto connection = listener.accept(0.25);
+        if (connection.valid()) {
+            connections.emplace_back(serve_worker, std::move(connection), std::cref(options),
+                                     std::cref(job), std::ref(queue), std::ref(fb),
+                                     std::ref(fb_mutex));
+            last_activity = std::chrono::steady_clock::now();
+        }
+        else if (queue.workers() > 0) {
+            last_activity = std::chrono::steady_clock::now();
+        }
+        else if (std::chrono::duration<double>(std::chrono::steady_clock::now() - last_activity).count()
+                 > options.idle_timeout) {
+            std::cerr << "Error: no workers connected for " << options.idle_timeout << " seconds\n";
+            queue.abort();
+        }
+    }
+
+    for (auto& connection : connections)
+        connection.join();
+    for (auto pid : children)
+        waitpid(pid, nullptr, 0);
+
+    if (queue.has_failed()) {
+        std::cerr << "Error: render aborted, tiles could not be completed\n";
+        return 1;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    std::clog << "Rendered with " << connections.size() << " worker connection(s) in "
+              << elapsed.count() << " s\n";
+
+    scoped_phase_timer timer("write");
+    if (!write_ppm("./image.ppm", fb)) {
+        std::cerr << "Error: could not write image.ppm\n";
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+// Runs a worker: connects to the coordinator (retrying while it starts up), builds the scene it
+// is told to, and renders tiles until told it is done. Returns the process exit code.
+inline int run_worker(const scene_builder& build, const distributed_options& options) {
+#if !RT_HAS_SOCKETS
+    std::cerr << "Distributed rendering is not supported on this platform\n";
+    return 1;
+#else
+    using namespace distributed;
+
+    socket_connection connection;
+    for (int attempt = 0; attempt < 100 && !connection.valid(); attempt++) {
+        connection = socket_connection::connect_to(options.host, options.port);
+        if (!connection.valid())
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (!connection.valid()) {
+        std::cerr << "Error: could not connect to " << options.host << ":" << options.port << '\n';
+        return 1;
+    }
+
+    message_header header{};
+    std::vector<char> payload;
+    if (!send_message(connection, message_type::hello, &protocol_magic, sizeof(protocol_magic)) ||
+        !receive_message(connection, header, payload) ||
+        header.type != std::uint32_t(message_type::job) || header.size != sizeof(job_config)) {
+        std::cerr << "Error: coordinator did not send a job\n";
+        return 1;
+    }
+
+    job_config job;
+    std::memcpy(&job, payload.data(), sizeof(job));
+
+    scene_arena arena;
+    hittable_list world;
+    camera cam;
+    if (!build_scene(build, job, arena, world, cam)) {
+        std::cerr << "Error: unknown scene " << job.scene << '\n';
+        return 1;
+    }
+
+    framebuffer out;
+    std::vector<char> result;
+    int rendered = 0;
+    while (receive_message(connection, header, payload)) {
+        if (header.type == std::uint32_t(message_type::done))
+            break;
+        if (header.type != std::uint32_t(message_type::tile) || header.size != sizeof(tile_request))
+            return 1;
+
+        tile_request request;
+        std::memcpy(&request, payload.data(), sizeof(request));
+        tile t{request.x0, request.y0, request.x1, request.y1};
+
+        out.clear();
+        cam.render_tile(world, t, out, cam.samples_per_pixel);
+
+        result.resize(sizeof(std::int32_t) + out.sum.size() * 3 * sizeof(float));
+        std::memcpy(result.data(), &request.index, sizeof(std::int32_t));
+        auto* sums = reinterpret_cast<float*>(result.data() + sizeof(std::int32_t));
+        for (size_t p = 0; p < out.sum.size(); p++) {
+            sums[3*p + 0] = float(out.sum[p].x());
+            sums[3*p + 1] = float(out.sum[p].y());
+            sums[3*p + 2] = float(out.sum[p].z());
+        }
+        if (!send_message(connection, message_type::result, result.data(), result.size()))
+            return 1;
+        rendered++;
+    }
+
+    std::clog << "Worker finished after " << rendered << " tile(s)\n";
+    return 0;
+#endif
+}
+
+#endif //DISTRIBUTED_H
@@ -0,0 +1,216 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "rt.h"
+
+#include "rt_stb_image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Image-based lighting. An HDR lat-long image surrounds the scene: rays that miss everything
+// return its radiance, and diffuse vertices sample it directly in proportion to its brightness,
+// so a small, bright sun is found by shadow rays instead of by the rare scattered ray that
+// happens to hit it.
+
+// Walker's alias method: picks index i with probability weights[i] / sum(weights) in constant
+// time, with one table lookup and one comparison.
+class alias_table {
+public:
+    alias_table() = default;
+
+    // Vose's construction. All-zero weights give a uniform table.
+    explicit alias_table(const std::vector<double>& weights) : bins(weights.size()), probabilities(weights.size()) {
+        auto n = weights.size();
+        double sum = 0;
+        for (auto w : weights)
+            sum += w;
+        for (size_t i = 0; i < n; i++)
+            probabilities[i] = sum > 0 ? weights[i] / sum : 1.0 / double(n);
+
+        // Bins scaled so the average is 1; a bin below 1 is topped up from one above it.
+        std::vector<double> scaled(n);
+        std::vector<std::uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = probabilities[i] * double(n);
+            (scaled[i] < 1 ? small : large).push_back(std::uint32_t(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            auto s = small.back(); small.pop_back();
+            auto l = large.back(); large.pop_back();
+            bins[s] = {scaled[s], l};
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+        // What is left is 1 up to rounding.
+        for (auto i : small) bins[i] = {1, i};
+        for (auto i : large) bins[i] = {1, i};
+    }
+
+    // Index for a uniform u in [0, 1).
+    [[nodiscard]] size_t sample(double u) const {
+        auto scaled = u * double(bins.size());
+        auto i = std::min(size_t(scaled), bins.size() - 1);
+        return scaled - double(i) < bins[i].threshold ? i : bins[i].alias;
+    }
+
+    [[nodiscard]] double pmf(size_t i) const { return probabilities[i]; }
+    [[nodiscard]] size_t size() const { return bins.size(); }
+
+private:
+    struct bin {
+        double threshold;           // Keep i when the fraction of u is below this
+        std::uint32_t alias;        // Otherwise take this index
+    };
+
+    std::vector<bin> bins;
+    std::vector<double> probabilities;
+};
+
+class environment_light {
+public:
+    // Loads an HDR (or LDR) lat-long image; radiance is scaled by scale.
+    explicit environment_light(const char* filename, double scale = 1) : scale(scale) {
+        rtw_image image(filename);
+        width = image.width();
+        height = image.height();
+        pixels.resize(size_t(width) * height);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++) {
+                auto p = image.float_pixel_data(x, y);
+                pixels[size_t(y) * width + x] = color(p[0], p[1], p[2]);
+            }
+        build_distribution();
+    }
+
+    // A width x height lat-long image in row-major order, top row first.
+    environment_light(int width, int height, std::vector<color> pixels, double scale = 1)
+        : width(width), height(height), scale(scale), pixels(std::move(pixels)) {
+        build_distribution();
+    }
+
+    // A procedural clear sky: a white-to-blue gradient above the horizon, grey ground below and
+    // a sun disc of angular radius sun_degrees with radiance sun_radiance.
+    static environment_light sun_sky(int width, int height, const vec3& sun_direction,
+                                     const color& sun_radiance, double sun_degrees = 0.5,
+                                     double scale = 1) {
+        std::vector<color> pixels(size_t(width) * height);
+        auto sun = unit_vector(sun_direction);
+        auto cos_sun = std::cos(degrees_to_radians(sun_degrees));
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++) {
+                auto d = direction_of((x + 0.5) / width, (y + 0.5) / height);
+                color c;
+                if (dot(d, sun) >= cos_sun)
+                    c = sun_radiance;
+                else if (d.y() >= 0)
+                    c = (1 - d.y()) * color(1, 1, 1) + d.y() * color(0.5, 0.7, 1.0);
+                else
+                    c = color(0.3, 0.3, 0.3);
+                pixels[size_t(y) * width + x] = c;
+            }
+        return environment_light(width, height, std::move(pixels), scale);
+    }
+
+    // Radiance arriving along -direction, i.e. seen when looking along direction.
+    [[nodiscard]] color radiance(const vec3& direction) const {
+        int x, y;
+        pixel_of(direction, x, y);
+        return scale * pixels[size_t(y) * width + x];
+    }
+
+    // Picks a direction with density proportional to the map's brightness. Returns false if the
+    // map is black.
+    bool sample(vec3& direction, color& radiance, double& pdf) const {
+        if (!lit)
+            return false;
+        auto y = rows.sample(random_double());
+        auto x = columns[y].sample(random_double());
+        auto u = (double(x) + random_double()) / width;
+        auto v = (double(y) + random_double()) / height;
+        auto sin_theta = std::sin(pi * v);
+        if (sin_theta <= 0)
+            return false;
+
+        direction = direction_of(u, v);
+        radiance = scale * pixels[y * size_t(width) + x];
+        pdf = rows.pmf(y) * columns[y].pmf(x) * double(width) * height / (2 * pi * pi * sin_theta);
+        return true;
+    }
+
+    // Solid-angle density with which sample() returns direction.
+    [[nodiscard]] double pdf(const vec3& direction) const {
+        if (!lit)
+            return 0;
+        int x, y;
+        auto sin_theta = pixel_of(direction, x, y);
+        if (sin_theta <= 0)
+            return 0;
+        return rows.pmf(size_t(y)) * columns[size_t(y)].pmf(size_t(x)) * double(width) * height
+             / (2 * pi * pi * sin_theta);
+    }
+
+private:
+    int width = 0, height = 0;
+    double scale = 1;
+    std::vector<color> pixels;
+    alias_table rows;                   // Row marginal
+    std::vector<alias_table> columns;   // Column within each row
+    bool lit = false;                   // Some pixel is not black
+
+    // Lat-long mapping: u turns around the Y axis, v runs from straight up (0) to straight
+    // down (1). It matches the UVs get_sphere_uv gives a sphere seen from inside, with v flipped
+    // to image rows like image_texture does.
+    static vec3 direction_of(double u, double v) {
+        auto theta = pi * v;
+        auto phi = 2 * pi * u;
+        return vec3(-std::cos(phi) * std::sin(theta), std::cos(theta), std::sin(phi) * std::sin(theta));
+    }
+
+    // The pixel containing direction; returns sin(theta) of the direction.
+    double pixel_of(const vec3& direction, int& x, int& y) const {
+        auto d = unit_vector(direction);
+        auto theta = std::acos(std::clamp(d.y(), -1.0, 1.0));
+        auto phi = std::atan2(-d.z(), d.x()) + pi;
+        x = std::clamp(int(phi / (2 * pi) * width), 0, width - 1);
+        y = std::clamp(int(theta / pi * height), 0, height - 1);
+        return std::sin(theta);
+    }
+
+    // Pixel weights are brightness times sin(theta), the solid angle of a pixel in its row.
+    void build_distribution() {
+        std::vector<double> row_weights(static_cast<size_t>(height));
+        std::vector<double> weights(static_cast<size_t>(width));
+        columns.reserve(size_t(height));
+        for (int y = 0; y < height; y++) {
+            auto sin_theta = std::sin(pi * (y + 0.5) / height);
+            double row = 0;
+            for (int x = 0; x < width; x++) {
+                const auto& c = pixels[size_t(y) * width + x];
+                weights[size_t(x)] = std::fmax(0, c.x() + c.y() + c.z()) * sin_theta;
+                row += weights[size_t(x)];
+            }
+            columns.emplace_back(weights);
+            row_weights[size_t(y)] = row;
+            lit = lit || row > 0;
+        }
+        rows = alias_table(row_weights);
+    }
+};
+
+// The environment named on the command line: "sun" for the procedural sun and sky, otherwise
+// an image file.
+inline environment_light make_environment(const std::string& name, double scale = 1) {
+    if (name == "sun")
+        return environment_light::sun_sky(1024, 512, vec3(-1, 1.2, 0.6), 20000 * color(1, 0.9, 0.8),
+                                          0.5, scale);
+    return environment_light(name.c_str(), scale);
+}
+
+#endif //ENVIRONMENT_H
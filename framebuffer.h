@@ -0,0 +1,147 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rt.h"
+
+#include "numa.h"
+
+#include <string>
+#include <vector>
+
+// Accumulates radiance sums for every pixel of an image. Every pixel has received the same
+// number of samples, so the pixel estimate is just the sum divided by that count.
+class framebuffer {
+public:
+    int width = 0;
+    int height = 0;
+    int samples = 0;                // Samples accumulated into every pixel so far
+    // Row-major radiance sums, top row first. Large buffers are mapped untouched, so each page
+    // is placed on the node of the render thread that first accumulates into it.
+    std::vector<color, page_allocator<color>> sum;
+    // Sums of squared samples, for a variance estimate; empty unless track_variance() was called.
+    std::vector<color, page_allocator<color>> sum_squares;
+
+    framebuffer() = default;
+    framebuffer(int width, int height) : width(width), height(height), sum(size_t(width) * height) {}
+
+    [[nodiscard]] color& at(int i, int j) { return sum[size_t(j) * width + i]; }
+    [[nodiscard]] const color& at(int i, int j) const { return sum[size_t(j) * width + i]; }
+
+    // The current estimate for a pixel (the mean of its samples).
+    [[nodiscard]] color pixel(int i, int j) const {
+        return samples > 0 ? at(i, j) / samples : color(0, 0, 0);
+    }
+
+    // The sample variance of a pixel's samples, per channel (zero without tracking).
+    [[nodiscard]] color variance(int i, int j) const {
+        if (sum_squares.empty() || samples < 2)
+            return color(0, 0, 0);
+        auto k = size_t(j) * width + i;
+        auto v = (sum_squares[k] - sum[k] * sum[k] / samples) / (samples - 1);
+        return color(std::fmax(v.x(), 0), std::fmax(v.y(), 0), std::fmax(v.z(), 0));
+    }
+
+    void track_variance() { sum_squares.assign(sum.size(), color(0, 0, 0)); }
+    [[nodiscard]] bool tracks_variance() const { return !sum_squares.empty(); }
+
+    // Reallocates the buffer, empty, at a new size; variance tracking is kept.
+    void reset(int new_width, int new_height) {
+        auto variance = tracks_variance();
+        *this = framebuffer(new_width, new_height);
+        if (variance)
+            track_variance();
+    }
+
+    void clear() {
+        std::fill(sum.begin(), sum.end(), color(0, 0, 0));
+        std::fill(sum_squares.begin(), sum_squares.end(), color(0, 0, 0));
+        samples = 0;
+    }
+};
+
+// A rectangle of pixels [x0, x1) x [y0, y1) of an image.
+struct tile {
+    int x0, y0, x1, y1;
+
+    [[nodiscard]] int width() const { return x1 - x0; }
+    [[nodiscard]] int height() const { return y1 - y0; }
+};
+
+// Splits a width x height image into tiles of at most tile_size x tile_size pixels, in
+// scanline order.
+inline std::vector<tile> make_tiles(int width, int height, int tile_size) {
+    std::vector<tile> tiles;
+    for (int y = 0; y < height; y += tile_size)
+        for (int x = 0; x < width; x += tile_size)
+            tiles.push_back({x, y, std::min(x + tile_size, width), std::min(y + tile_size, height)});
+    return tiles;
+}
+
+// Writes the image as an 8-bit gamma-corrected plain PPM, the format the renderer always used.
+inline bool write_ppm(const std::string& filename, const framebuffer& fb) {
+    std::ofstream out(filename);
+    if (!out.is_open())
+        return false;
+
+    out << "P3\n" << fb.width << " " << fb.height << "\n255\n";
+    for (int j = 0; j < fb.height; j++)
+        for (int i = 0; i < fb.width; i++)
+            write_color(out, fb.pixel(i, j));
+    return true;
+}
+
+// Writes the linear pixel estimates as a little-endian PFM (portable float map). Unlike PPM this
+// keeps full HDR precision, which is what error metrics against a reference need.
+inline bool write_pfm(const std::string& filename, const framebuffer& fb) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        return false;
+
+    out << "PF\n" << fb.width << " " << fb.height << "\n-1.0\n";
+
+    // PFM stores rows bottom to top.
+    std::vector<float> row(size_t(fb.width) * 3);
+    for (int j = fb.height - 1; j >= 0; j--) {
+        for (int i = 0; i < fb.width; i++) {
+            auto c = fb.pixel(i, j);
+            row[3*i + 0] = float(c.x());
+            row[3*i + 1] = float(c.y());
+            row[3*i + 2] = float(c.z());
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+    }
+    return bool(out);
+}
+
+// Reads a PFM written by write_pfm into a framebuffer holding a single sample per pixel.
+// Returns false if the file is missing or is not a little-endian RGB PFM.
+inline bool read_pfm(const std::string& filename, framebuffer& fb) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open())
+        return false;
+
+    std::string magic;
+    int width, height;
+    double scale;
+    in >> magic >> width >> height >> scale;
+    in.get();   // The single whitespace character before the pixel data
+    if (!in || magic != "PF" || scale >= 0 || width <= 0 || height <= 0)
+        return false;
+
+    fb = framebuffer(width, height);
+    fb.samples = 1;
+
+    std::vector<float> row(size_t(width) * 3);
+    for (int j = height - 1; j >= 0; j--) {
+        in.read(reinterpret_cast<char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+        for (int i = 0; i < width; i++)
+            fb.at(i, j) = color(row[3*i + 0], row[3*i + 1], row[3*i + 2]);
+    }
+    return bool(in);
+}
+
+#endif //FRAMEBUFFER_H
@@ -7,6 +7,7 @@
 
 #include "aabb.h"
 
+class hittable;
 class material;
 
 class hit_record {
@@ -14,6 +15,7 @@ public:
     point3 p;                   // The point where the ray hits
     vec3 normal;                // Surface normal of the point where the ray hit
     shared_ptr<material> mat;
+    const hittable* object = nullptr;   // Primitive that was hit, if it is in world space
     double t;                   // The root of the function of ray, since ray is just a line
     double u;
     double v;
@@ -30,13 +32,61 @@ public:
     }
 };
 
+// Built-in primitives that BVH traversal calls directly instead of through the virtual hit().
+// Everything else, including user-defined hittables, is `other` and keeps virtual dispatch.
+enum class hittable_kind : unsigned char {
+    other, sphere, moving_sphere, quad, axis_aligned_quad, disk, ellipse, cuboid, bvh_node
+};
+
 class hittable {
 public:
     virtual ~hittable() = default;
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
 
+    // Whether anything blocks the ray within ray_t, for shadow and visibility rays. Unlike
+    // hit() it may stop at the first intersection it finds and fills no hit record. The default
+    // falls back to hit(); the built-in objects answer it without the shading work.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
+    // Fraction of light that gets through along the ray within ray_t, for shadow rays that
+    // can pass through participating media. Opaque objects let nothing or everything through,
+    // so the default answers it with occluded().
+    virtual double transmittance(const ray& r, interval ray_t) const {
+        return occluded(r, ray_t) ? 0 : 1;
+    }
+
     virtual aabb bounding_box() const = 0;
+
+    // Area light support. Primitives that can be sampled as lights return their surface area,
+    // their material and, for r1, r2 in [0, 1), a point distributed uniformly over the surface.
+    // Everything else keeps the defaults and is never sampled directly.
+    struct surface_sample {
+        point3 p;
+        vec3 normal;
+        double u, v;
+    };
+
+    virtual double surface_area() const { return 0; }
+    virtual surface_sample sample_surface(double /*r1*/, double /*r2*/) const { return {}; }
+    virtual shared_ptr<material> surface_material() const { return nullptr; }
+
+    // Recomputes the bounding box after this object, or anything it contains, has moved.
+    // Objects that never change shape can keep the default.
+    virtual void refit() {}
+
+    // Concrete type for the closed-set dispatch in bvh_node::hit_child. Tagged classes mark
+    // hit() final, so the tag always names the implementation that runs.
+    [[nodiscard]] hittable_kind kind() const { return type_tag; }
+
+protected:
+    explicit hittable(hittable_kind kind = hittable_kind::other) : type_tag(kind) {}
+
+private:
+    hittable_kind type_tag;
 };
 
 class translate : public hittable {
@@ -58,14 +108,33 @@ public:
 
         // move intersection point forward by the offset amount
         rec.p += offset;
+        rec.object = nullptr;       // Not a world-space primitive
 
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        return object->occluded(ray(r.origin() - offset, r.direction(), r.time()), ray_t);
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return object->transmittance(ray(r.origin() - offset, r.direction(), r.time()), ray_t);
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
 
+    void set_offset(const vec3& new_offset) {
+        offset = new_offset;
+        bbox = object->bounding_box() + offset;
+    }
+
+    void refit() override {
+        object->refit();
+        bbox = object->bounding_box() + offset;
+    }
+
 private:
     shared_ptr<hittable> object;
     vec3 offset;
@@ -78,51 +147,13 @@ public:
         auto radians = degrees_to_radians(angle);
         sin_theta = std::sin(radians);
         cos_theta = std::cos(radians);
-        bbox = object->bounding_box();
-
-        point3 min( infinity,  infinity,  infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                    auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                    auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                    auto newx =  cos_theta*x + sin_theta*z;
-                    auto newz = -sin_theta*x + cos_theta*z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = std::fmin(min[c], tester[c]);
-                        max[c] = std::fmax(max[c], tester[c]);
-                    }
-                }
-            }
-        }
-
-        bbox = aabb(min, max);
+        set_bounding_box();
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
 
         // Transform the ray from world space to object space.
-
-        auto origin = point3(
-            (cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
-            r.origin().y(),
-            (sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
-        );
-
-        auto direction = vec3(
-            (cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
-            r.direction().y(),
-            (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
-        );
-
-        ray rotated_r(origin, direction, r.time());
+        ray rotated_r = to_object_space(r);
 
         // Determine whether an intersection exists in object space (and if so, where).
 
@@ -143,18 +174,78 @@ public:
             rec.normal.y(),
             (-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
         );
+        rec.object = nullptr;
 
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        return object->occluded(to_object_space(r), ray_t);
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return object->transmittance(to_object_space(r), ray_t);
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
 
+    void refit() override {
+        object->refit();
+        set_bounding_box();
+    }
+
 private:
     shared_ptr<hittable> object;
     double sin_theta;
     double cos_theta;
     aabb bbox;
+
+    ray to_object_space(const ray& r) const {
+        auto origin = point3(
+            (cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
+            r.origin().y(),
+            (sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
+        );
+
+        auto direction = vec3(
+            (cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
+            r.direction().y(),
+            (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
+        );
+
+        return ray(origin, direction, r.time());
+    }
+
+    void set_bounding_box() {
+        // Bounding box of the rotated corners of the object's own bounding box.
+        bbox = object->bounding_box();
+
+        point3 min( infinity,  infinity,  infinity);
+        point3 max(-infinity, -infinity, -infinity);
+
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) {
+                for (int k = 0; k < 2; k++) {
+                    auto x = i*bbox.x.max + (1-i)*bbox.x.min;
+                    auto y = j*bbox.y.max + (1-j)*bbox.y.min;
+                    auto z = k*bbox.z.max + (1-k)*bbox.z.min;
+
+                    auto newx =  cos_theta*x + sin_theta*z;
+                    auto newz = -sin_theta*x + cos_theta*z;
+
+                    vec3 tester(newx, y, newz);
+
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = std::fmin(min[c], tester[c]);
+                        max[c] = std::fmax(max[c], tester[c]);
+                    }
+                }
+            }
+        }
+
+        bbox = aabb(min, max);
+    }
 };
 #endif //HITTABLE_H
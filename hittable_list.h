@@ -39,8 +39,33 @@ public:
         return hit_anything;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects)
+            if (object->occluded(r, ray_t))
+                return true;
+        return false;
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        double fraction = 1;
+        for (const auto& object : objects) {
+            fraction *= object->transmittance(r, ray_t);
+            if (fraction == 0)
+                break;
+        }
+        return fraction;
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    void refit() override {
+        bbox = aabb();
+        for (const auto& object : objects) {
+            object->refit();
+            bbox = aabb(bbox, object->bounding_box());
+        }
+    }
+
 private:
     aabb bbox;
 };
@@ -46,7 +46,7 @@ public:
 };
 
 const interval interval::empty =    interval(+infinity, -infinity);
-const interval interval::universe = interval(+infinity, -infinity);
+const interval interval::universe = interval(-infinity, +infinity);
 
 inline interval operator+(const interval& i, double displacement) {
     return {i.min + displacement, i.max + displacement};
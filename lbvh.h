@@ -0,0 +1,310 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef LBVH_H
+#define LBVH_H
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Linear BVH builder (LBVH/HLBVH). Primitives are ordered along a Morton curve through their
+// centroids and the hierarchy falls out of the sorted codes: every node splits where the
+// highest differing code bit flips. There is no cost evaluation, so the build is a handful of
+// linear passes, at the price of a somewhat worse tree than the median split builder.
+//
+// With treelet_bits > 0 the build is hierarchical: primitives sharing their top treelet_bits
+// code bits form a treelet built by LBVH, and the few levels above the treelets are built with
+// the surface area heuristic, which recovers most of the quality lost near the root.
+namespace lbvh {
+
+struct primitive_ref {
+    std::uint64_t code;
+    std::uint32_t index;
+};
+
+constexpr int morton_bits = 63;             // 21 bits per axis
+
+// Calls body(begin, end) over consecutive blocks of [0, count) on the global pool, so per-item
+// passes pay the scheduling cost once per block rather than once per item.
+template <typename Body>
+void parallel_blocks(size_t count, Body body) {
+    constexpr size_t block = 16384;
+    thread_pool::global().parallel_for((count + block - 1) / block, [&](size_t b) {
+        body(b * block, std::min(count, (b + 1) * block));
+    });
+}
+
+// Spreads the low 21 bits of v so there are two zero bits between each of them.
+inline std::uint64_t expand_bits(std::uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+// Morton code of a point given in [0, 1]^3.
+inline std::uint64_t morton_code(double x, double y, double z) {
+    constexpr double scale = double((1 << 21) - 1);
+    auto quantize = [](double v) { return std::uint64_t(std::clamp(v, 0.0, 1.0) * scale); };
+    return expand_bits(quantize(x)) << 2 | expand_bits(quantize(y)) << 1 | expand_bits(quantize(z));
+}
+
+// Stable LSD radix sort on the code, 8 bits per pass. Each pass histograms and scatters
+// fixed-size chunks in parallel; passes whose digit is the same for every key are skipped.
+inline void radix_sort(std::vector<primitive_ref>& refs) {
+    constexpr size_t chunk = 65536;
+    auto chunks = (refs.size() + chunk - 1) / chunk;
+    std::vector<primitive_ref> scratch(refs.size());
+    std::vector<std::array<size_t, 256>> offsets(chunks);
+    auto& pool = thread_pool::global();
+
+    for (int shift = 0; shift < morton_bits; shift += 8) {
+        pool.parallel_for(chunks, [&](size_t c) {
+            auto& histogram = offsets[c];
+            histogram.fill(0);
+            auto last = std::min(refs.size(), (c + 1) * chunk);
+            for (size_t i = c * chunk; i < last; i++)
+                histogram[(refs[i].code >> shift) & 0xff]++;
+        });
+
+        // Exclusive prefix over (digit, chunk) turns the counts into scatter positions.
+        size_t total = 0;
+        bool single_digit = false;
+        for (int digit = 0; digit < 256; digit++) {
+            auto digit_start = total;
+            for (size_t c = 0; c < chunks; c++) {
+                auto count = offsets[c][digit];
+                offsets[c][digit] = total;
+                total += count;
+            }
+            if (total - digit_start == refs.size())
+                single_digit = true;
+        }
+        if (single_digit)
+            continue;
+
+        pool.parallel_for(chunks, [&](size_t c) {
+            auto& position = offsets[c];
+            auto last = std::min(refs.size(), (c + 1) * chunk);
+            for (size_t i = c * chunk; i < last; i++)
+                scratch[position[(refs[i].code >> shift) & 0xff]++] = refs[i];
+        });
+        refs.swap(scratch);
+    }
+}
+
+// Index of the last element of the first child of refs[first, last]: the last position whose
+// code shares more leading bits with refs[first] than refs[last] does. Ranges of identical
+// codes are split in the middle.
+inline size_t find_split(const std::vector<primitive_ref>& refs, size_t first, size_t last) {
+    auto first_code = refs[first].code;
+    auto last_code = refs[last].code;
+    if (first_code == last_code)
+        return (first + last) / 2;
+
+    auto common_prefix = std::countl_zero(first_code ^ last_code);
+
+    // Binary search for the highest position that still shares more than common_prefix bits.
+    size_t split = first;
+    size_t step = last - first;
+    do {
+        step = (step + 1) / 2;
+        auto candidate = split + step;
+        if (candidate < last && std::countl_zero(first_code ^ refs[candidate].code) > common_prefix)
+            split = candidate;
+    } while (step > 1);
+    return split;
+}
+
+// Emits the subtree over refs[first, last]. Large ranges build their children in parallel.
+inline shared_ptr<hittable> emit(const std::vector<primitive_ref>& refs,
+                                 const std::vector<shared_ptr<hittable>>& objects,
+                                 size_t first, size_t last, scene_arena* arena) {
+    if (first == last)
+        return objects[refs[first].index];
+
+    auto split = find_split(refs, first, last);
+    shared_ptr<hittable> left, right;
+    if (last - first + 1 >= bvh_node::parallel_build_threshold) {
+        task_group group;
+        group.run([&] { left = emit(refs, objects, first, split, arena); });
+        right = emit(refs, objects, split + 1, last, arena);
+        group.wait();
+    }
+    else {
+        left  = emit(refs, objects, first, split, arena);
+        right = emit(refs, objects, split + 1, last, arena);
+    }
+    return make_object<bvh_node>(arena, std::move(left), std::move(right));
+}
+
+struct treelet {
+    shared_ptr<hittable> root;
+    aabb bbox;
+    point3 centroid;
+    size_t primitives;
+};
+
+// Builds the levels above the treelets with a full sweep of the surface area heuristic along
+// each axis. There are at most 2^treelet_bits treelets, so this stays cheap.
+inline shared_ptr<hittable> build_sah(std::vector<treelet>& treelets, size_t start, size_t end,
+                                      scene_arena* arena) {
+    if (end - start == 1)
+        return treelets[start].root;
+
+    size_t best_split = start + (end - start) / 2;
+    int best_axis = -1;
+    auto best_cost = infinity;
+    std::vector<double> right_cost(end - start);
+    std::vector<treelet> best_order;    // The order best_split was costed on
+
+    for (int axis = 0; axis < 3; axis++) {
+        std::sort(treelets.begin() + start, treelets.begin() + end,
+                  [axis](const treelet& a, const treelet& b) { return a.centroid[axis] < b.centroid[axis]; });
+
+        // right_cost[k] = area * primitives of treelets[start + k, end)
+        auto box = aabb::empty;
+        size_t count = 0;
+        for (size_t i = end; i-- > start + 1;) {
+            box = aabb(box, treelets[i].bbox);
+            count += treelets[i].primitives;
+            right_cost[i - start] = box.surface_area() * double(count);
+        }
+
+        box = aabb::empty;
+        count = 0;
+        auto improved = false;
+        for (size_t i = start; i + 1 < end; i++) {
+            box = aabb(box, treelets[i].bbox);
+            count += treelets[i].primitives;
+            auto cost = box.surface_area() * double(count) + right_cost[i + 1 - start];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i + 1;
+                improved = true;
+            }
+        }
+        // Tied centroids may come out of another sort in a different order, so the winning
+        // permutation itself is kept rather than sorted for again.
+        if (improved)
+            best_order.assign(treelets.begin() + start, treelets.begin() + end);
+    }
+
+    if (best_axis >= 0 && best_axis != 2)
+        std::move(best_order.begin(), best_order.end(), treelets.begin() + start);
+
+    auto left = build_sah(treelets, start, best_split, arena);
+    auto right = build_sah(treelets, best_split, end, arena);
+    return make_object<bvh_node>(arena, std::move(left), std::move(right));
+}
+
+} // namespace lbvh
+
+// Builds an LBVH over the list's objects. treelet_bits = 0 gives a pure LBVH; otherwise the
+// top of the tree (above treelets sharing their first treelet_bits code bits, at most 30) is
+// built with the surface area heuristic. With an arena, the nodes are allocated from it.
+inline shared_ptr<bvh_node> build_lbvh(const hittable_list& list, int treelet_bits = 0,
+                                       scene_arena* arena = nullptr) {
+    const auto& objects = list.objects;
+    auto n = objects.size();
+    if (n == 0)
+        return make_object<bvh_node>(arena, list, arena);
+
+    // Object boxes and the bounds of their centroids.
+    std::vector<aabb> boxes(n);
+    lbvh::parallel_blocks(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            boxes[i] = objects[i]->bounding_box();
+    });
+
+    auto centroid = [](const aabb& box, int axis) {
+        const auto& range = box.axis_interval(axis);
+        return 0.5 * (range.min + range.max);
+    };
+    double low[3] = {infinity, infinity, infinity};
+    double high[3] = {-infinity, -infinity, -infinity};
+    for (const auto& box : boxes)
+        for (int axis = 0; axis < 3; axis++) {
+            low[axis] = std::min(low[axis], centroid(box, axis));
+            high[axis] = std::max(high[axis], centroid(box, axis));
+        }
+
+    std::vector<lbvh::primitive_ref> refs(n);
+    lbvh::parallel_blocks(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            double unit[3];
+            for (int axis = 0; axis < 3; axis++) {
+                auto extent = high[axis] - low[axis];
+                unit[axis] = extent > 0 ? (centroid(boxes[i], axis) - low[axis]) / extent : 0.5;
+            }
+            refs[i] = {lbvh::morton_code(unit[0], unit[1], unit[2]), std::uint32_t(i)};
+        }
+    });
+    lbvh::radix_sort(refs);
+
+    if (n == 1)
+        return make_object<bvh_node>(arena, objects[0], objects[0]);
+
+    if (treelet_bits <= 0) {
+        auto root = lbvh::emit(refs, objects, 0, n - 1, arena);
+        return std::static_pointer_cast<bvh_node>(root);
+    }
+
+    // Runs of equal code prefixes are the treelets.
+    auto shift = lbvh::morton_bits - std::min(treelet_bits, 30);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t first = 0; first < n;) {
+        auto last = first;
+        while (last + 1 < n && (refs[last + 1].code >> shift) == (refs[first].code >> shift))
+            last++;
+        ranges.emplace_back(first, last);
+        first = last + 1;
+    }
+
+    std::vector<lbvh::treelet> treelets(ranges.size());
+    thread_pool::global().parallel_for(ranges.size(), [&](size_t t) {
+        auto [first, last] = ranges[t];
+        auto& result = treelets[t];
+        result.root = lbvh::emit(refs, objects, first, last, arena);
+        result.bbox = result.root->bounding_box();
+        result.centroid = point3(centroid(result.bbox, 0), centroid(result.bbox, 1),
+                                 centroid(result.bbox, 2));
+        result.primitives = last - first + 1;
+    });
+
+    auto root = lbvh::build_sah(treelets, 0, treelets.size(), arena);
+    if (auto node = std::dynamic_pointer_cast<bvh_node>(root))
+        return node;
+    return make_object<bvh_node>(arena, root, root);
+}
+
+// The BVH builders the renderer can use.
+enum class bvh_builder {
+    median_split,       // Top-down median split on the longest axis (bvh_node's own builder)
+    lbvh,               // Morton-ordered linear BVH: fastest build, lower quality
+    hlbvh,              // LBVH treelets with an SAH-built top: fast build, closer quality
+};
+
+inline shared_ptr<bvh_node> build_bvh(const hittable_list& list, bvh_builder builder,
+                                      scene_arena* arena = nullptr) {
+    switch (builder) {
+        case bvh_builder::lbvh:  return build_lbvh(list, 0, arena);
+        case bvh_builder::hlbvh: return build_lbvh(list, 12, arena);
+        default:                 return make_object<bvh_node>(arena, list, arena);
+    }
+}
+
+#endif //LBVH_H
@@ -0,0 +1,317 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "rt.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Light selection for next event estimation. Every primitive with a diffuse_light material that
+// can be sampled (sphere, quad) becomes an area light. At each diffuse path vertex one light is
+// picked and a point on it is sampled. A light BVH picks it with probability proportional to a
+// conservative estimate of its contribution at the shading point, so far, dim or badly facing
+// lights are rarely chosen and noise stays about the same as the light count grows.
+
+// How camera::ray_color picks the light to sample.
+enum class light_sampling {
+    none,       // No light sampling; lights are only found by scattered rays
+    uniform,    // Every light equally likely
+    bvh,        // Light BVH, in proportion to estimated contribution
+};
+
+inline bool parse_light_sampling(const std::string& name, light_sampling& mode) {
+    if (name == "none")         mode = light_sampling::none;
+    else if (name == "uniform") mode = light_sampling::uniform;
+    else if (name == "bvh")     mode = light_sampling::bvh;
+    else return false;
+    return true;
+}
+
+// True for primitives that light_set can sample, if it finds them while collecting the scene.
+inline bool is_light_surface(const hittable& object, const material& mat) {
+    return mat.kind() == material_kind::diffuse_light && object.surface_area() > 0;
+}
+
+inline point3 box_center(const aabb& box) {
+    return point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+}
+
+inline vec3 box_diagonal(const aabb& box) {
+    return vec3(box.x.size(), box.y.size(), box.z.size());
+}
+
+// Spatial and directional bounds of one or more lights, after the light bounds of Conty and
+// Kulla's many-lights hierarchy (as in pbrt-v4): a box, the total power, and a cone around axis
+// of half-angle theta_o containing every surface normal, with emission falling off to zero at
+// theta_e beyond it.
+struct light_bounds {
+    aabb bounds;
+    double phi = 0;             // Power estimate
+    vec3 axis = vec3(0, 0, 1);
+    double cos_theta_o = 1;
+    double cos_theta_e = 0;
+    bool two_sided = false;
+
+    // Upper bound on the contribution to a point p with surface normal n (zero vector: none),
+    // up to a common factor.
+    [[nodiscard]] double importance(const point3& p, const vec3& n) const {
+        auto center = box_center(bounds);
+        auto diagonal = box_diagonal(bounds);
+        auto d2 = std::max((p - center).length_squared(), 0.5 * diagonal.length());
+
+        // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b.
+        auto cos_sub_clamped = [](double sin_a, double cos_a, double sin_b, double cos_b) {
+            return cos_a > cos_b ? 1.0 : cos_a * cos_b + sin_a * sin_b;
+        };
+        auto sin_sub_clamped = [](double sin_a, double cos_a, double sin_b, double cos_b) {
+            return cos_a > cos_b ? 0.0 : sin_a * cos_b - cos_a * sin_b;
+        };
+        auto sine = [](double cosine) { return std::sqrt(std::fmax(0, 1 - cosine * cosine)); };
+
+        auto wi = unit_vector(p - center);
+        auto cos_theta_w = dot(axis, wi);
+        if (two_sided)
+            cos_theta_w = std::fabs(cos_theta_w);
+        auto sin_theta_w = sine(cos_theta_w);
+
+        // Angle the bounds subtend from p, through their bounding sphere.
+        auto radius2 = 0.25 * diagonal.length_squared();
+        auto distance2 = (p - center).length_squared();
+        auto cos_theta_b = distance2 <= radius2 ? -1.0 : std::sqrt(std::fmax(0, 1 - radius2 / distance2));
+        auto sin_theta_b = sine(cos_theta_b);
+
+        // Smallest possible angle between an emitted direction toward p and the normal cone.
+        auto sin_theta_o = sine(cos_theta_o);
+        auto cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        auto sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        auto cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+        if (cos_theta_p <= cos_theta_e)
+            return 0;
+
+        auto importance = phi * cos_theta_p / d2;
+        if (n.length_squared() > 0) {
+            auto cos_theta_i = std::fabs(dot(wi, n));
+            auto cos_theta_i_p = cos_sub_clamped(sine(cos_theta_i), cos_theta_i, sin_theta_b, cos_theta_b);
+            importance *= cos_theta_i_p;
+        }
+        return std::fmax(importance, 0);
+    }
+};
+
+// Smallest cone (roughly) containing the cones a and b.
+inline void merge_cones(const light_bounds& a, const light_bounds& b, vec3& axis, double& cos_theta_o) {
+    auto theta_a = std::acos(std::clamp(a.cos_theta_o, -1.0, 1.0));
+    auto theta_b = std::acos(std::clamp(b.cos_theta_o, -1.0, 1.0));
+    auto theta_d = std::acos(std::clamp(dot(a.axis, b.axis), -1.0, 1.0));
+
+    if (std::fmin(theta_d + theta_b, pi) <= theta_a) {
+        axis = a.axis;
+        cos_theta_o = a.cos_theta_o;
+        return;
+    }
+    if (std::fmin(theta_d + theta_a, pi) <= theta_b) {
+        axis = b.axis;
+        cos_theta_o = b.cos_theta_o;
+        return;
+    }
+
+    auto theta_o = 0.5 * (theta_a + theta_d + theta_b);
+    auto rotation_axis = cross(a.axis, b.axis);
+    if (theta_o >= pi || rotation_axis.length_squared() == 0) {
+        axis = a.axis;
+        cos_theta_o = -1;
+        return;
+    }
+
+    // Rotate a's axis toward b's by theta_o - theta_a (Rodrigues' formula).
+    auto k = unit_vector(rotation_axis);
+    auto theta_r = theta_o - theta_a;
+    axis = a.axis * std::cos(theta_r) + cross(k, a.axis) * std::sin(theta_r)
+         + k * dot(k, a.axis) * (1 - std::cos(theta_r));
+    cos_theta_o = std::cos(theta_o);
+}
+
+inline light_bounds merge(const light_bounds& a, const light_bounds& b) {
+    if (a.phi == 0) return b;
+    if (b.phi == 0) return a;
+    light_bounds merged;
+    merged.bounds = aabb(a.bounds, b.bounds);
+    merged.phi = a.phi + b.phi;
+    merge_cones(a, b, merged.axis, merged.cos_theta_o);
+    merged.cos_theta_e = std::fmin(a.cos_theta_e, b.cos_theta_e);
+    merged.two_sided = a.two_sided || b.two_sided;
+    return merged;
+}
+
+// The sampleable lights of a scene and the structure that picks among them.
+class light_set {
+public:
+    struct choice {
+        const hittable* light;
+        material* mat;          // Its emitting material
+        double pmf;             // Probability that this light was picked
+    };
+
+    // Collects the lights of scene, descending into nested lists. Call it on the scene before
+    // the scene is wrapped in a BVH.
+    light_set(const hittable_list& scene, light_sampling mode) : mode(mode) {
+        collect(scene);
+        sorted_lights = lights;
+        std::sort(sorted_lights.begin(), sorted_lights.end(), std::less<>());
+        if (mode == light_sampling::bvh && !lights.empty()) {
+            std::vector<size_t> order(lights.size());
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+            nodes.reserve(2 * lights.size() - 1);
+            build(order, 0, order.size());
+        }
+    }
+
+    [[nodiscard]] size_t size() const { return lights.size(); }
+
+    // Whether object is one of the collected lights. Its emission is left out when a scattered
+    // ray from a vertex that sampled a light hits it, since light sampling already counted it.
+    [[nodiscard]] bool contains(const hittable* object) const {
+        return std::binary_search(sorted_lights.begin(), sorted_lights.end(), object, std::less<>());
+    }
+    [[nodiscard]] bool empty() const { return lights.empty() || mode == light_sampling::none; }
+
+    // Picks a light for the shading point p with normal n. Returns false if no light can
+    // contribute there.
+    bool sample(const point3& p, const vec3& n, choice& picked) const {
+        if (empty())
+            return false;
+        if (mode == light_sampling::uniform) {
+            auto index = std::min(size_t(random_double() * double(lights.size())), lights.size() - 1);
+            picked = {lights[index], materials[index], 1.0 / double(lights.size())};
+            return true;
+        }
+
+        // One uniform number for the whole descent, rescaled at every step.
+        auto u = random_double();
+        size_t node = 0;
+        double pmf = 1;
+        while (!nodes[node].leaf()) {
+            auto left = node + 1;
+            auto right = size_t(nodes[node].right);
+            auto left_importance = nodes[left].bounds.importance(p, n);
+            auto right_importance = nodes[right].bounds.importance(p, n);
+            if (left_importance == 0 && right_importance == 0)
+                return false;
+
+            auto p_left = left_importance / (left_importance + right_importance);
+            if (u < p_left) {
+                node = left;
+                pmf *= p_left;
+                u = std::fmin(u / p_left, 1 - 1e-12);
+            }
+            else {
+                node = right;
+                pmf *= 1 - p_left;
+                u = std::fmin((u - p_left) / (1 - p_left), 1 - 1e-12);
+            }
+        }
+        if (pmf == 0 || nodes[node].bounds.importance(p, n) == 0)
+            return false;
+        auto index = size_t(nodes[node].light);
+        picked = {lights[index], materials[index], pmf};
+        return true;
+    }
+
+private:
+    // Light BVH node, in depth-first order: an interior node's left child follows it directly.
+    struct light_node {
+        light_bounds bounds;
+        int right = -1;         // Index of the right child, for interior nodes
+        int light = -1;         // Index into lights, for leaves
+
+        [[nodiscard]] bool leaf() const { return light >= 0; }
+    };
+
+    light_sampling mode;
+    std::vector<const hittable*> lights;
+    std::vector<const hittable*> sorted_lights;     // lights by address, for contains()
+    std::vector<material*> materials;
+    std::vector<light_bounds> light_bounds_of;
+    std::vector<light_node> nodes;
+
+    void collect(const hittable_list& list) {
+        for (const auto& object : list.objects) {
+            if (auto nested = dynamic_cast<const hittable_list*>(object.get())) {
+                collect(*nested);
+                continue;
+            }
+            auto mat = object->surface_material();
+            if (!mat || !is_light_surface(*object, *mat))
+                continue;
+            lights.push_back(object.get());
+            materials.push_back(mat.get());
+            light_bounds_of.push_back(bounds_of(*object, *mat));
+        }
+    }
+
+    static light_bounds bounds_of(const hittable& object, material& mat) {
+        auto area = object.surface_area();
+        auto s = object.sample_surface(0.5, 0.5);
+        auto emission = emitted_light(mat, s.u, s.v, s.p);
+
+        light_bounds b;
+        b.bounds = object.bounding_box();
+        b.phi = pi * area * luminance(emission);
+        b.cos_theta_e = 0;      // Diffuse emitters fall off to zero at 90 degrees
+        b.two_sided = true;     // diffuse_light emits from both sides
+        switch (object.kind()) {
+            case hittable_kind::quad:
+            case hittable_kind::axis_aligned_quad:
+                b.axis = s.normal;
+                b.cos_theta_o = 1;
+                break;
+            default:
+                b.cos_theta_o = -1;   // Normals in every direction
+                break;
+        }
+        return b;
+    }
+
+    // Median split on the longest axis of the light centers, like bvh_node.
+    int build(std::vector<size_t>& order, size_t start, size_t end) {
+        auto index = int(nodes.size());
+        nodes.emplace_back();
+        if (end - start == 1) {
+            nodes[size_t(index)].bounds = light_bounds_of[order[start]];
+            nodes[size_t(index)].light = int(order[start]);
+            return index;
+        }
+
+        auto centers = aabb::empty;
+        for (auto i = start; i < end; i++) {
+            auto center = box_center(light_bounds_of[order[i]].bounds);
+            centers = aabb(centers, aabb(center, center));
+        }
+        auto axis = centers.longest_axis();
+        auto mid = start + (end - start) / 2;
+        std::nth_element(order.begin() + long(start), order.begin() + long(mid), order.begin() + long(end),
+                         [&](size_t a, size_t b) {
+                             return light_bounds_of[a].bounds.axis_interval(axis).min
+                                  < light_bounds_of[b].bounds.axis_interval(axis).min;
+                         });
+
+        build(order, start, mid);
+        auto right = build(order, mid, end);
+        nodes[size_t(index)].right = right;
+        nodes[size_t(index)].bounds = merge(nodes[size_t(index) + 1].bounds, nodes[size_t(right)].bounds);
+        return index;
+    }
+};
+
+#endif //LIGHT_H
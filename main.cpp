@@ -1,27 +1,45 @@
 #include "rt.h"
 
+#include "animation.h"
+#include "arena.h"
+#include "benchmark.h"
 #include "bvh.h"
 #include "camera.h"
+#include "cuboid.h"
+#include "distributed.h"
+#include "environment.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "lbvh.h"
+#include "light.h"
 #include "material.h"
+#include "medium.h"
+#include "partial_render.h"
+#include "path_guide.h"
 #include "quad.h"
+#include "replicated_scene.h"
+#include "sampler.h"
+#include "scaling_bench.h"
 #include "sphere.h"
 #include "texture.h"
+#include "views.h"
 
+#include <cstring>
+#include <sstream>
 
-static void wide_angle_spheres(hittable_list &world, camera &cam) {
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    auto material_dielectric = make_shared<dielectric>(1.5);
-    auto material_bubble = make_shared<dielectric>(1.0 / 1.5);
-    auto material_metal = make_shared<metal>(color(0.2, 0.5, 0.7), 0);
-    auto material_lambertian = make_shared<lambertian>(color(0.2, 0.2, 0.8));
 
-    auto sphere_ground = make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material);
-    auto sphere_left = make_shared<sphere>(point3(-1, 0.5, -1), 0.49, material_dielectric);
-    auto sphere_bubble = make_shared<sphere>(point3(-1, 0.5, -1), 0.45, material_bubble);
-    auto sphere_middle = make_shared<sphere>(point3(0, 0.5, -1), 0.49, material_metal);
-    auto sphere_right = make_shared<sphere>(point3(1, 0.5, -1), 0.49, material_lambertian);
+static void wide_angle_spheres(scene_arena &arena, hittable_list &world, camera &cam) {
+    auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+    auto material_dielectric = arena.make<dielectric>(1.5);
+    auto material_bubble = arena.make<dielectric>(1.0 / 1.5);
+    auto material_metal = arena.make<metal>(color(0.2, 0.5, 0.7), 0);
+    auto material_lambertian = arena.make<lambertian>(color(0.2, 0.2, 0.8));
+
+    auto sphere_ground = make_sphere(point3(0, -1000, 0), 1000, ground_material, &arena);
+    auto sphere_left = make_sphere(point3(-1, 0.5, -1), 0.49, material_dielectric, &arena);
+    auto sphere_bubble = make_sphere(point3(-1, 0.5, -1), 0.45, material_bubble, &arena);
+    auto sphere_middle = make_sphere(point3(0, 0.5, -1), 0.49, material_metal, &arena);
+    auto sphere_right = make_sphere(point3(1, 0.5, -1), 0.49, material_lambertian, &arena);
 
     world.add(sphere_ground);
     world.add(sphere_left);
@@ -46,10 +64,11 @@ static void wide_angle_spheres(hittable_list &world, camera &cam) {
     cam.focus_dist = 10.0;
 }
 
-static void bouncing_spheres(hittable_list &world, camera &cam) {
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+static void bouncing_spheres(scene_arena &arena, hittable_list &world, camera &cam,
+                             animation *anim = nullptr) {
+    auto ground_material = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+    auto checker = arena.make<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_sphere(point3(0, -1000, 0), 1000, arena.make<lambertian>(checker), &arena));
 
     for (int a = -11; a < 11; ++a) {
         for (int b = -11; b < 11; ++b) {
@@ -64,30 +83,39 @@ static void bouncing_spheres(hittable_list &world, camera &cam) {
                 if (choose_mat < 0.8) {
                     // Lambertian
                     auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
+                    sphere_material = arena.make<lambertian>(albedo);
                     //auto center2 = center + point3(0, random_double(0, 0.2), 0);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    auto bouncing = make_sphere(center, 0.2, sphere_material, &arena);
+                    world.add(bouncing);
+
+                    if (anim) {
+                        // One bounce per second, each sphere with its own height and phase
+                        auto top = center + vec3(0, random_double(0.2, 1.0), 0);
+                        auto phase = random_double(0, 0.5);
+                        anim->keyframe_center(bouncing, {{phase, center}, {phase + 0.5, top},
+                                                         {phase + 1.0, center}});
+                    }
                 } else if (choose_mat < 0.95) {
                     auto albedo = color::random() * color::random();
                     auto fuzz = random_double(0, 0.4);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = arena.make<metal>(albedo, fuzz);
+                    world.add(make_sphere(center, 0.2, sphere_material, &arena));
                 } else {
                     // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = arena.make<dielectric>(1.5);
+                    world.add(make_sphere(center, 0.2, sphere_material, &arena));
                 }
             }
         }
     }
 
-    auto material1 = make_shared<dielectric>(1.5);
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0);
+    auto material1 = arena.make<dielectric>(1.5);
+    auto material2 = arena.make<lambertian>(color(0.4, 0.2, 0.1));
+    auto material3 = arena.make<metal>(color(0.7, 0.6, 0.5), 0);
 
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    world.add(make_sphere(point3(0, 1, 0), 1.0, material1, &arena));
+    world.add(make_sphere(point3(-4, 1, 0), 1.0, material2, &arena));
+    world.add(make_sphere(point3(4, 1, 0), 1.0, material3, &arena));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -105,18 +133,18 @@ static void bouncing_spheres(hittable_list &world, camera &cam) {
     cam.focus_dist = 10.0;
 }
 
-static void zoomed_spheres(hittable_list &world, camera &cam) {
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left = make_shared<dielectric>(1.50);
-    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 0.5);
+static void zoomed_spheres(scene_arena &arena, hittable_list &world, camera &cam) {
+    auto material_ground = arena.make<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = arena.make<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left = arena.make<dielectric>(1.50);
+    auto material_bubble = arena.make<dielectric>(1.00 / 1.50);
+    auto material_right = arena.make<metal>(color(0.8, 0.6, 0.2), 0.5);
 
-    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.2), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.4, material_bubble));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    world.add(make_sphere(point3(0.0, -100.5, -1.0), 100.0, material_ground, &arena));
+    world.add(make_sphere(point3(0.0, 0.0, -1.2), 0.5, material_center, &arena));
+    world.add(make_sphere(point3(-1.0, 0.0, -1.0), 0.5, material_left, &arena));
+    world.add(make_sphere(point3(-1.0, 0.0, -1.0), 0.4, material_bubble, &arena));
+    world.add(make_sphere(point3(1.0, 0.0, -1.0), 0.5, material_right, &arena));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -134,10 +162,10 @@ static void zoomed_spheres(hittable_list &world, camera &cam) {
     cam.focus_dist = 10.0;
 }
 
-static void checkered_spheres(hittable_list &world, camera &cam) {
-    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-    world.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
-    world.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
+static void checkered_spheres(scene_arena &arena, hittable_list &world, camera &cam) {
+    auto checker = arena.make<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_sphere(point3(0, -10, 0), 10, arena.make<lambertian>(checker), &arena));
+    world.add(make_sphere(point3(0, 10, 0), 10, arena.make<lambertian>(checker), &arena));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -154,10 +182,10 @@ static void checkered_spheres(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0;
 }
 
-static void earth(hittable_list &world, camera &cam) {
-    auto earth_texture = make_shared<image_texture>("earthmap2.jpg");
-    auto earth_surface = make_shared<lambertian>(earth_texture);
-    auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+static void earth(scene_arena &arena, hittable_list &world, camera &cam) {
+    auto earth_texture = arena.make<image_texture>("earthmap2.jpg");
+    auto earth_surface = arena.make<lambertian>(earth_texture);
+    auto globe = make_sphere(point3(0, 0, 0), 2, earth_surface, &arena);
     world.add(globe);
 
     cam.aspect_ratio = 16.0 / 9.0;
@@ -175,10 +203,10 @@ static void earth(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0;
 }
 
-static void perlin(hittable_list &world, camera &cam) {
-    auto per_text = make_shared<noise_texture>(4);
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(per_text)));
-    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(per_text)));
+static void perlin(scene_arena &arena, hittable_list &world, camera &cam) {
+    auto per_text = arena.make<noise_texture>(4);
+    world.add(make_sphere(point3(0, -1000, 0), 1000, arena.make<lambertian>(per_text), &arena));
+    world.add(make_sphere(point3(0, 2, 0), 2, arena.make<lambertian>(per_text), &arena));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -195,20 +223,20 @@ static void perlin(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0;
 }
 
-static void quads(hittable_list &world, camera &cam) {
+static void quads(scene_arena &arena, hittable_list &world, camera &cam) {
     // Materials
-    auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
-    auto back_green = make_shared<lambertian>(color(0.2, 1.0, 0.2));
-    auto right_blue = make_shared<lambertian>(color(0.2, 0.2, 1.0));
-    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
-    auto lower_teal = make_shared<lambertian>(color(0.2, 0.8, 0.8));
+    auto left_red = arena.make<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green = arena.make<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue = arena.make<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = arena.make<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal = arena.make<lambertian>(color(0.2, 0.8, 0.8));
 
     // Quads
-    world.add(make_shared<quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
-    world.add(make_shared<quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
-    world.add(make_shared<quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
-    world.add(make_shared<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
-    world.add(make_shared<quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
+    world.add(make_quad(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red, &arena));
+    world.add(make_quad(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green, &arena));
+    world.add(make_quad(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue, &arena));
+    world.add(make_quad(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange, &arena));
+    world.add(make_quad(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal, &arena));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -225,20 +253,20 @@ static void quads(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0;
 }
 
-static void ellipses(hittable_list &world, camera &cam) {
+static void ellipses(scene_arena &arena, hittable_list &world, camera &cam) {
     // Materials
-    auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
-    auto back_green = make_shared<lambertian>(color(0.2, 1.0, 0.2));
-    auto right_blue = make_shared<lambertian>(color(0.2, 0.2, 1.0));
-    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
-    auto lower_teal = make_shared<lambertian>(color(0.2, 0.8, 0.8));
+    auto left_red = arena.make<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green = arena.make<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue = arena.make<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = arena.make<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal = arena.make<lambertian>(color(0.2, 0.8, 0.8));
 
     // ellipses and disks
-    world.add(make_shared<disk>(point3(-3,-2, 4), vec3(0, 0,-4), vec3(0, 4, 0), 1, left_red));
-    world.add(make_shared<ellipse>(point3(0, 0, 0), vec3(2, 0, 0), vec3(0, 1, 0), back_green));
-    world.add(make_shared<disk>(point3( 3,0, 1), vec3(0, 0, 4), vec3(0, 4, 0), 1, right_blue));
-    world.add(make_shared<disk>(point3(-2, 1, 1), vec3(4, 2, 0), vec3(0, 0, 4),1, upper_orange));
-    world.add(make_shared<disk>(point3(-2.8,-3, 4), vec3(4, 0, 0), vec3(0, 0,-4), 1, lower_teal));
+    world.add(arena.make<disk>(point3(-3,-2, 4), vec3(0, 0,-4), vec3(0, 4, 0), 1, left_red));
+    world.add(arena.make<ellipse>(point3(0, 0, 0), vec3(2, 0, 0), vec3(0, 1, 0), back_green));
+    world.add(arena.make<disk>(point3( 3,0, 1), vec3(0, 0, 4), vec3(0, 4, 0), 1, right_blue));
+    world.add(arena.make<disk>(point3(-2, 1, 1), vec3(4, 2, 0), vec3(0, 0, 4),1, upper_orange));
+    world.add(arena.make<disk>(point3(-2.8,-3, 4), vec3(4, 0, 0), vec3(0, 0,-4), 1, lower_teal));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 800;
@@ -255,15 +283,15 @@ static void ellipses(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0;
 }
 
-static void simple_light(hittable_list& world, camera& cam) {
-    auto pertext = make_shared<noise_texture>(4);
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(pertext)));
-    world.add(make_shared<sphere>(point3(0,2,0), 2, make_shared<lambertian>(pertext)));
+static void simple_light(scene_arena &arena, hittable_list& world, camera& cam) {
+    auto pertext = arena.make<noise_texture>(4);
+    world.add(make_sphere(point3(0,-1000,0), 1000, arena.make<lambertian>(pertext), &arena));
+    world.add(make_sphere(point3(0,2,0), 2, arena.make<lambertian>(pertext), &arena));
 
-    auto difflight = make_shared<diffuse_light>(color(4,4,4));
-    world.add(make_shared<quad>(point3(3,1,-2), vec3(2,0,0), vec3(0,2,0), difflight));
-    world.add(make_shared<sphere>(point3(0,7,0), 2, difflight));
-    // world.add(make_shared<quad>(point3(1,1,6), vec3(2,0,0), vec3(0,2,0), difflight));
+    auto difflight = arena.make<diffuse_light>(color(4,4,4));
+    world.add(make_quad(point3(3,1,-2), vec3(2,0,0), vec3(0,2,0), difflight, &arena));
+    world.add(make_sphere(point3(0,7,0), 2, difflight, &arena));
+    // world.add(make_quad(point3(1,1,6), vec3(2,0,0), vec3(0,2,0), difflight, &arena));
 
     cam.aspect_ratio      = 16.0 / 9.0;
     cam.image_width       = 800;
@@ -279,29 +307,19 @@ static void simple_light(hittable_list& world, camera& cam) {
     cam.defocus_angle = 0;
 }
 
-static void cornell_box(hittable_list& world, camera& cam) {
-
-    auto red   = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+// The walls, light and camera of the Cornell box, without the boxes.
+static void cornell_room(scene_arena &arena, hittable_list& world, camera& cam) {
+    auto red   = arena.make<lambertian>(color(.65, .05, .05));
+    auto white = arena.make<lambertian>(color(.73, .73, .73));
+    auto green = arena.make<lambertian>(color(.12, .45, .15));
+    auto light = arena.make<diffuse_light>(color(15, 15, 15));
 
-    world.add(make_shared<quad>(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
-    world.add(make_shared<quad>(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
-    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), light));
-    world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
-    world.add(make_shared<quad>(point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), white));
-    world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
-
-    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265,0,295));
-    world.add(box1);
-
-    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165,165,165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130,0,65));
-    world.add(box2);
+    world.add(make_quad(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green, &arena));
+    world.add(make_quad(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red, &arena));
+    world.add(make_quad(point3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), light, &arena));
+    world.add(make_quad(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white, &arena));
+    world.add(make_quad(point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), white, &arena));
+    world.add(make_quad(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white, &arena));
 
     cam.aspect_ratio      = 1.0;
     cam.image_width       = 600;
@@ -317,8 +335,524 @@ static void cornell_box(hittable_list& world, camera& cam) {
     cam.defocus_angle = 0;
 }
 
-int main() {
+static void cornell_box(scene_arena &arena, hittable_list& world, camera& cam,
+                        animation *anim = nullptr) {
+    cornell_room(arena, world, cam);
+    auto white = arena.make<lambertian>(color(.73, .73, .73));
+
+    auto box1 = cuboid::rotated_y(point3(0,0,0), point3(165,330,165), white, 15, vec3(265,0,295), &arena);
+    world.add(box1);
+
+    auto box2 = cuboid::rotated_y(point3(0,0,0), point3(165,165,165), white, -18, vec3(130,0,65), &arena);
+    world.add(box2);
+
+    if (anim) {
+        // The boxes slide past each other over two seconds
+        anim->keyframe_position(box1, {{0, point3(265,0,295)}, {2, point3(100,0,295)}});
+        anim->keyframe_position(box2, {{0, point3(130,0,65)}, {2, point3(300,0,65)}});
+    }
+}
+
+// Hundreds of small lights with powers over three orders of magnitude, floating over a floor
+// with a few diffuse spheres, plus a grid of dim ceiling panels facing down. Compares the
+// light sampling strategies of --lights.
+static void many_lights(scene_arena &arena, hittable_list& world, camera& cam) {
+    auto ground = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_sphere(point3(0,-1000,0), 1000, ground, &arena));
+
+    for (int a = -3; a <= 3; a++) {
+        auto albedo = arena.make<lambertian>(color::random(0.3, 0.9));
+        world.add(make_sphere(point3(3 * a, 1, 0), 1, albedo, &arena));
+    }
+
+    for (int k = 0; k < 400; k++) {
+        point3 center(random_double(-15, 15), random_double(0.5, 2), random_double(-15, 15));
+        auto power = std::pow(10.0, random_double(-1, 2));
+        auto light = arena.make<diffuse_light>(power * color::random(0.2, 1));
+        world.add(make_sphere(center, 0.1, light, &arena));
+    }
+
+    auto panel = arena.make<diffuse_light>(color(0.5, 0.5, 0.5));
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 8; j++)
+            world.add(make_quad(point3(-16 + 4 * i, 8, -16 + 4 * j), vec3(1,0,0), vec3(0,0,1), panel, &arena));
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 600;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 10;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(0, 10, 22);
+    cam.lookat   = point3(0, 0, 0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+}
+
+// The Cornell box with a baffle hung under the light, so the room is lit only by light that
+// first bounces off the ceiling around the baffle's edges. Hard for cosine-weighted scattering
+// and for light sampling alike; a test case for --guide.
+static void cornell_box_hidden_light(scene_arena &arena, hittable_list& world, camera& cam) {
+    cornell_box(arena, world, cam);
+    auto white = arena.make<lambertian>(color(.73, .73, .73));
+    world.add(make_quad(point3(173, 500, 187), vec3(210,0,0), vec3(0,0,185), white, &arena));
+}
+
+// The Cornell box filled with thin fog, which scatters the light into a visible cone under the
+// ceiling lamp. Every path crosses the medium, so it is a test case for volume tracking cost.
+static void cornell_fog(scene_arena &arena, hittable_list& world, camera& cam) {
+    cornell_box(arena, world, cam);
+    auto room = arena.make<cuboid>(point3(0, 0, 0), point3(555, 555, 555), nullptr);
+    world.add(arena.make<constant_medium>(room, 0.0008, color(0.9, 0.9, 0.9), &arena));
+}
+
+// A cloud of Perlin smoke in the empty Cornell room. Its density falls to zero toward the edge
+// of a sphere, so much of the medium's box is empty or thin and the majorant grid skips it.
+static void cornell_smoke(scene_arena &arena, hittable_list& world, camera& cam) {
+    cornell_room(arena, world, cam);
+    point3 center(278, 240, 278);
+    double radius = 200;
+    auto bounds = arena.make<cuboid>(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius),
+                                     nullptr);
+    class perlin noise;     // The scene function perlin() hides the class name
+    auto density = [&](const point3 &p) {
+        auto falloff = 1 - (p - center).length() / radius;
+        return falloff > 0 ? 0.2 * falloff * noise.turb(0.02 * p, 4) : 0.0;
+    };
+    world.add(arena.make<grid_medium>(bounds, density, color(0.8, 0.8, 0.8), 96, 16, &arena));
+}
+
+static bool build_scene(int choice, scene_arena &arena, hittable_list &world, camera &cam) {
+    switch (choice) {
+        case 1: wide_angle_spheres(arena, world, cam);
+            return true;
+        case 2: bouncing_spheres(arena, world, cam);
+            return true;
+        case 3: zoomed_spheres(arena, world, cam);
+            return true;
+        case 4: checkered_spheres(arena, world, cam);
+            return true;
+        case 5: earth(arena, world, cam);
+            return true;
+        case 6: perlin(arena, world, cam);
+            return true;
+        case 7: quads(arena, world, cam);
+            return true;
+        case 8: ellipses(arena, world, cam);
+            return true;
+        case 9: simple_light(arena, world, cam);
+            return true;
+        case 10: cornell_box(arena, world, cam);
+            return true;
+        case 11: many_lights(arena, world, cam);
+            return true;
+        case 12: cornell_box_hidden_light(arena, world, cam);
+            return true;
+        case 13: cornell_fog(arena, world, cam);
+            return true;
+        case 14: cornell_smoke(arena, world, cam);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Builds a scene together with its animation. Scenes with moving objects set up their own
+// tracks; every other scene gets a quarter turntable orbit of the camera around its target.
+static bool build_animated_scene(int choice, scene_arena &arena, hittable_list &world, camera &cam,
+                                 animation &anim) {
+    if (choice == 2)
+        bouncing_spheres(arena, world, cam, &anim);
+    else if (choice == 10)
+        cornell_box(arena, world, cam, &anim);
+    else if (!build_scene(choice, arena, world, cam))
+        return false;
+
+    if (anim.camera_lookfrom.empty() && choice != 10) {
+        auto seconds = (anim.last_frame - anim.first_frame + 1) / anim.fps;
+        auto arm = cam.lookfrom - cam.lookat;
+        constexpr int keys = 8;
+        for (int k = 0; k <= keys; k++) {
+            auto angle = (pi / 2) * k / keys;
+            auto rotated = vec3(std::cos(angle) * arm.x() + std::sin(angle) * arm.z(), arm.y(),
+                                -std::sin(angle) * arm.x() + std::cos(angle) * arm.z());
+            anim.camera_lookfrom.add(anim.frame_time(anim.first_frame) + seconds * k / keys,
+                                     cam.lookat + rotated);
+        }
+    }
+    return true;
+}
+
+static constexpr int scene_count = 14;
+
+// Builds one BVH-wrapped copy of the scene per NUMA node, each from the same seed so the
+// copies are identical. The arenas own the copies and must outlive the returned scene.
+static shared_ptr<hittable> build_replicated(int choice, bvh_builder builder, unsigned seed,
+                                             std::vector<std::unique_ptr<scene_arena>> &arenas) {
+    for (int node = 0; node < numa_topology::system().node_count(); node++)
+        arenas.push_back(std::make_unique<scene_arena>());
+    auto replicas = build_per_node([&](int node) -> shared_ptr<hittable> {
+        hittable_list objects;
+        camera unused;
+        seed_random(seed);
+        build_scene(choice, *arenas[node], objects, unused);
+        return build_bvh(objects, builder, arenas[node].get());
+    });
+    return make_shared<replicated_scene>(replicas);
+}
+
+// Adds up partial renders and writes the image to output: a PFM if the name ends in ".pfm",
+// otherwise a PPM. If every input tracked variance, the variance of each pixel's estimate goes
+// to a PFM next to it (image.ppm: image_variance.pfm).
+static int merge_partial_files(const std::string &output, const std::vector<std::string> &inputs) {
+    framebuffer merged;
+    std::string error;
+    if (!merge_partials(inputs, merged, error)) {
+        std::cerr << "Error: " << error << '\n';
+        return 1;
+    }
+    auto dot = output.rfind('.');
+    auto extension = dot == std::string::npos ? "" : output.substr(dot);
+    if (!(extension == ".pfm" ? write_pfm(output, merged) : write_ppm(output, merged))) {
+        std::cerr << "Error: could not write " << output << '\n';
+        return 1;
+    }
+    std::cout << "Merged " << inputs.size() << " partial renders, " << merged.samples << " samples per pixel\n";
+
+    if (merged.tracks_variance()) {
+        framebuffer variance(merged.width, merged.height);
+        variance.samples = 1;
+        for (int j = 0; j < merged.height; j++)
+            for (int i = 0; i < merged.width; i++)
+                variance.at(i, j) = merged.variance(i, j) / merged.samples;
+        auto name = output.substr(0, dot) + "_variance.pfm";
+        if (!write_pfm(name, variance)) {
+            std::cerr << "Error: could not write " << name << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [--scene N] [--bvh median|lbvh|hlbvh] [--replicate]"
+                 " [--ray-order depth|breadth|sorted] [--lights none|uniform|bvh]"
+                 " [--env FILE|sun] [--env-scale S] [--guide]"
+                 " [--sampler independent|stratified|halton|sobol] [--width W]"
+                 " [--tiled FILE [--tile-size N] | [--time-budget SECONDS] [--denoise] [--aovs PREFIX]]\n"
+              << "       " << program << " --assemble TILED OUT.ppm|OUT.pfm\n"
+              << "       " << program << " --sample-range FIRST:COUNT --partial FILE [--scene N] [--width W]"
+                 " [--seed S] [--seed-offset K] [--variance] [--lights none|uniform|bvh] [--env FILE|sun]"
+                 " [--sampler independent|stratified|halton|sobol]\n"
+              << "       " << program << " --merge OUT.ppm|OUT.pfm PARTIAL...\n"
+              << "       " << program << " --bench [--bench-scenes 1,2,...] [--bench-seconds S]"
+                 " [--bench-width W] [--seed S] [--reference-dir DIR] [--make-reference SPP]"
+                 " [--lights none|uniform|bvh] [--env FILE|sun] [--guide]"
+                 " [--sampler independent|stratified|halton|sobol] [--denoise]\n"
+              << "       " << program << " --coordinator PORT [--scene N] [--width W] [--seed S]"
+                 " [--tile-size N] [--spawn-workers N]\n"
+              << "       " << program << " --worker HOST:PORT\n"
+              << "       " << program << " --animate FIRST:LAST [--scene N] [--width W] [--fps F]"
+                 " [--frames-dir DIR] [--rebuild-threshold X]\n"
+              << "       " << program << " --views stereo|cubemap|turntable:N [--scene N] [--width W]"
+                 " [--eye-separation D] [--bvh median|lbvh|hlbvh] [--replicate] [--env FILE|sun]"
+                 " [--sampler independent|stratified|halton|sobol]\n"
+              << "       " << program << " --ray-order-bench [--scene N] [--bench-width W]"
+                 " [--bench-spp N] [--seed S]\n"
+              << "       " << program << " --scaling-bench [--scene N] [--bench-width W]"
+                 " [--bench-threads N] [--seed S]\n"
+              << "Placement options for every mode: [--affinity none|compact|scatter]"
+                 " [--pages normal|thp|huge]\n";
+}
+
+int main(int argc, char *argv[]) {
+    int choice = 10;
+    bool bench = false;
+    scene_bench_options bench_options;
+    bool coordinator = false;
+    bool worker = false;
+    distributed_options distributed_options;
+    distributed_options.program = argv[0];
+    bool animate = false;
+    animation anim;
+    animation_options animation_options;
+    std::string views_mode;
+    double eye_separation = 0.065;
+    auto builder = bvh_builder::median_split;
+    bool scaling_bench = false;
+    scaling_bench_options scaling_options;
+    bool replicate = false;
+    auto ordering = ray_ordering::depth_first;
+    bool ray_order_bench = false;
+    int bench_spp = 16;
+    auto light_mode = light_sampling::none;
+    std::string environment_name;
+    double environment_scale = 1;
+    bool guiding = false;
+    auto sampling = sampler_kind::independent;
+    std::string tiled_file;
+    std::string partial_file;
+    int first_sample = 0, sample_count = 0;
+    unsigned seed_offset = 0;
+    bool track_variance = false;
+    bool denoise = false;
+    std::string aov_prefix;
+    double time_budget = 0;
+
+    for (int i = 1; i < argc; i++) {
+        auto has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--scene") && has_value)
+            choice = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--bench"))
+            bench = true;
+        else if (!std::strcmp(argv[i], "--bench-scenes") && has_value) {
+            std::stringstream list(argv[++i]);
+            std::string scene;
+            while (std::getline(list, scene, ','))
+                bench_options.scenes.push_back(std::atoi(scene.c_str()));
+        }
+        else if (!std::strcmp(argv[i], "--bench-seconds") && has_value)
+            bench_options.seconds_per_scene = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--bench-width") && has_value)
+            bench_options.image_width = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && has_value)
+            bench_options.seed = distributed_options.seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--reference-dir") && has_value)
+            bench_options.reference_dir = argv[++i];
+        else if (!std::strcmp(argv[i], "--make-reference") && has_value)
+            bench_options.reference_spp = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--coordinator") && has_value) {
+            coordinator = true;
+            distributed_options.port = std::atoi(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--worker") && has_value) {
+            worker = true;
+            std::string address = argv[++i];
+            auto colon = address.rfind(':');
+            if (colon == std::string::npos) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            distributed_options.host = address.substr(0, colon);
+            distributed_options.port = std::atoi(address.c_str() + colon + 1);
+        }
+        else if (!std::strcmp(argv[i], "--width") && has_value)
+            distributed_options.image_width = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--animate") && has_value) {
+            animate = true;
+            if (std::sscanf(argv[++i], "%d:%d", &anim.first_frame, &anim.last_frame) != 2) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--fps") && has_value)
+            anim.fps = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--frames-dir") && has_value)
+            animation_options.frames_dir = argv[++i];
+        else if (!std::strcmp(argv[i], "--rebuild-threshold") && has_value)
+            animation_options.rebuild_threshold = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--views") && has_value)
+            views_mode = argv[++i];
+        else if (!std::strcmp(argv[i], "--eye-separation") && has_value)
+            eye_separation = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--bvh") && has_value) {
+            std::string name = argv[++i];
+            if (name == "median")
+                builder = bvh_builder::median_split;
+            else if (name == "lbvh")
+                builder = bvh_builder::lbvh;
+            else if (name == "hlbvh")
+                builder = bvh_builder::hlbvh;
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--affinity") && has_value) {
+            if (!parse_affinity(argv[++i], thread_pool::global_options().affinity)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--pages") && has_value) {
+            std::string name = argv[++i];
+            if (name == "normal")
+                default_page_mode() = page_mode::normal;
+            else if (name == "thp")
+                default_page_mode() = page_mode::transparent;
+            else if (name == "huge")
+                default_page_mode() = page_mode::huge;
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--replicate"))
+            replicate = true;
+        else if (!std::strcmp(argv[i], "--scaling-bench"))
+            scaling_bench = true;
+        else if (!std::strcmp(argv[i], "--bench-threads") && has_value)
+            scaling_options.max_threads = unsigned(std::max(1, std::atoi(argv[++i])));
+        else if (!std::strcmp(argv[i], "--ray-order") && has_value) {
+            if (!parse_ray_ordering(argv[++i], ordering)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--lights") && has_value) {
+            if (!parse_light_sampling(argv[++i], light_mode)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            bench_options.lights = light_mode;
+        }
+        else if (!std::strcmp(argv[i], "--env") && has_value)
+            environment_name = bench_options.environment = argv[++i];
+        else if (!std::strcmp(argv[i], "--env-scale") && has_value)
+            environment_scale = bench_options.environment_scale = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--guide"))
+            guiding = bench_options.guiding = true;
+        else if (!std::strcmp(argv[i], "--sampler") && has_value) {
+            if (!parse_sampler_kind(argv[++i], sampling)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            bench_options.sampling = sampling;
+        }
+        else if (!std::strcmp(argv[i], "--tiled") && has_value)
+            tiled_file = argv[++i];
+        else if (!std::strcmp(argv[i], "--assemble") && i + 2 < argc) {
+            if (!assemble_tiled_image(argv[i + 1], argv[i + 2])) {
+                std::cerr << "Error: could not convert " << argv[i + 1] << " to " << argv[i + 2] << '\n';
+                return 1;
+            }
+            return 0;
+        }
+        else if (!std::strcmp(argv[i], "--sample-range") && has_value) {
+            if (std::sscanf(argv[++i], "%d:%d", &first_sample, &sample_count) != 2 || first_sample < 0
+                || sample_count <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--partial") && has_value)
+            partial_file = argv[++i];
+        else if (!std::strcmp(argv[i], "--seed-offset") && has_value)
+            seed_offset = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--variance"))
+            track_variance = true;
+        else if (!std::strcmp(argv[i], "--denoise"))
+            denoise = bench_options.denoise = true;
+        else if (!std::strcmp(argv[i], "--aovs") && has_value)
+            aov_prefix = argv[++i];
+        else if (!std::strcmp(argv[i], "--time-budget") && has_value)
+            time_budget = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--merge") && i + 2 < argc)
+            return merge_partial_files(argv[i + 1], std::vector<std::string>(argv + i + 2, argv + argc));
+        else if (!std::strcmp(argv[i], "--ray-order-bench"))
+            ray_order_bench = true;
+        else if (!std::strcmp(argv[i], "--bench-spp") && has_value)
+            bench_spp = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--tile-size") && has_value)
+            distributed_options.tile_size = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--spawn-workers") && has_value)
+            distributed_options.spawn_workers = std::atoi(argv[++i]);
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // A time budget sizes passes over the whole frame, but tiled and sample-range renders take
+    // all their samples at once, and they never hold the finished frame to denoise.
+    auto finishing = time_budget > 0 || denoise || !aov_prefix.empty();
+    if (finishing && (!tiled_file.empty() || !partial_file.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    distributed_options.scene = choice;
+    if (coordinator)
+        return run_coordinator(build_scene, distributed_options);
+    if (worker)
+        return run_worker(build_scene, distributed_options);
+
+    if (animate) {
+        scene_arena arena;
+        hittable_list objects;
+        camera cam;
+        seed_random(distributed_options.seed);
+        if (!build_animated_scene(choice, arena, objects, cam, anim)) {
+            std::cerr << "Unknown scene " << choice << '\n';
+            return 1;
+        }
+        if (distributed_options.image_width > 0)
+            cam.image_width = distributed_options.image_width;
+        return render_animation(objects, cam, anim, animation_options, std::cout);
+    }
+
+    if (!views_mode.empty()) {
+        scene_arena arena;
+        hittable_list world;
+        camera cam;
+        seed_random(distributed_options.seed);
+        if (!build_scene(choice, arena, world, cam)) {
+            std::cerr << "Unknown scene " << choice << '\n';
+            return 1;
+        }
+        if (distributed_options.image_width > 0)
+            cam.image_width = distributed_options.image_width;
+        light_set lights(world, light_mode);
+        cam.lights = &lights;
+        std::unique_ptr<environment_light> environment;
+        if (!environment_name.empty())
+            environment = std::make_unique<environment_light>(make_environment(environment_name, environment_scale));
+        cam.environment = environment.get();
+        world = hittable_list(build_bvh(world, builder, &arena));
+        std::vector<std::unique_ptr<scene_arena>> replica_arenas;
+        if (replicate)
+            world = hittable_list(build_replicated(choice, builder, distributed_options.seed, replica_arenas));
+
+        cam.ordering = ordering;
+        cam.sampling = sampling;
+        std::vector<camera> views;
+        int count = 0;
+        if (views_mode == "stereo")
+            views = stereo_views(cam, eye_separation);
+        else if (views_mode == "cubemap")
+            views = cube_map_views(cam);
+        else if (std::sscanf(views_mode.c_str(), "turntable:%d", &count) == 1 && count > 0)
+            views = turntable_views(cam, count);
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return render_multiview(world, views, std::cout);
+    }
+
+    if (ray_order_bench)
+        return run_ray_order_benchmark(build_scene, bench_options, choice, bench_spp, std::cout);
+
+    if (scaling_bench) {
+        scaling_options.scene = choice;
+        scaling_options.seed = bench_options.seed;
+        if (bench_options.image_width > 0)
+            scaling_options.image_width = bench_options.image_width;
+        return run_scaling_benchmark(build_scene, scaling_options, std::cout);
+    }
+
+    if (bench) {
+        if (bench_options.scenes.empty())
+            for (int scene = 1; scene <= scene_count; scene++)
+                bench_options.scenes.push_back(scene);
+        return run_scene_benchmark(build_scene, bench_options, std::cout);
+    }
+
     //set the world
+    scene_arena arena;
     hittable_list world;
     camera cam;
     std::cout << "Please enter the scene number to render: " << std::endl;
@@ -332,41 +866,84 @@ int main() {
     std::cout << "08: Scene-08, Disks and Ellipses " << std::endl;
     std::cout << "09: Scene-09, A Simple light for lighting " << std::endl;
     std::cout << "10: Scene-10, Cornell Box " << std::endl;
-
-    int choice = 10;
-    if (false)
-        std::cin >> choice;
-    switch (choice) {
-        case 1: wide_angle_spheres(world, cam);
-            break;
-        case 2: bouncing_spheres(world, cam);
-            break;
-        case 3: zoomed_spheres(world, cam);
-            break;
-        case 4: checkered_spheres(world, cam);
-            break;
-        case 5: earth(world, cam);
-            break;
-        case 6: perlin(world, cam);
-            break;
-        case 7: quads(world, cam);
-            break;
-        case 8: ellipses(world, cam);
-            break;
-        case 9: simple_light(world, cam);
-            break;
-        case 10: cornell_box(world, cam);
-            break;
-
-        default:
-            std::cout << "Please enter a valid choice number" << std::endl;
+    std::cout << "11: Scene-11, Many Lights " << std::endl;
+    std::cout << "12: Scene-12, Cornell Box with a Hidden Light " << std::endl;
+    std::cout << "13: Scene-13, Cornell Box in Fog " << std::endl;
+    std::cout << "14: Scene-14, Smoke Cloud in the Cornell Room " << std::endl;
+
+    auto scene_timer = std::make_unique<scoped_phase_timer>("scene_setup");
+    // Every process of a split render must build the same scene.
+    if (replicate || !partial_file.empty())
+        seed_random(distributed_options.seed);
+    if (!build_scene(choice, arena, world, cam))
+        std::cout << "Please enter a valid choice number" << std::endl;
+    scene_timer.reset();
+    // Collected before the BVH hides the scene's objects.
+    light_set lights(world, light_mode);
+    cam.lights = &lights;
+    std::unique_ptr<environment_light> environment;
+    if (!environment_name.empty()) {
+        scoped_phase_timer timer("environment");
+        environment = std::make_unique<environment_light>(make_environment(environment_name, environment_scale));
     }
+    cam.environment = environment.get();
+    std::unique_ptr<path_guide> guide;
+    if (guiding)
+        guide = std::make_unique<path_guide>(world.bounding_box());
+    cam.guide = guide.get();
+
     auto start_time = std::chrono::system_clock::now();
-    world = hittable_list(make_shared<bvh_node>(world));
-    cam.render(world);
+    {
+        scoped_phase_timer timer("bvh_build");
+        world = hittable_list(build_bvh(world, builder, &arena));
+    }
+    std::vector<std::unique_ptr<scene_arena>> replica_arenas;
+    if (replicate) {
+        scoped_phase_timer timer("replicate");
+        world = hittable_list(build_replicated(choice, builder, distributed_options.seed, replica_arenas));
+    }
+    cam.ordering = ordering;
+    cam.sampling = sampling;
+    cam.denoise = denoise;
+    cam.aov_prefix = aov_prefix;
+    cam.time_budget = time_budget;
+    if (distributed_options.image_width > 0)
+        cam.image_width = distributed_options.image_width;
+    if (!partial_file.empty()) {
+        if (sample_count == 0)
+            sample_count = cam.samples_per_pixel;
+        cam.seed = seed_offset;
+        auto fb = cam.make_framebuffer();
+        if (track_variance)
+            fb.track_variance();
+        {
+            scoped_phase_timer timer("render");
+            cam.render_sample_range(world, fb, first_sample, sample_count, true);
+        }
+        partial_header header{fb.width, fb.height, choice, distributed_options.seed, first_sample, sample_count,
+                              seed_offset, track_variance};
+        if (!write_partial(partial_file, header, fb)) {
+            std::cerr << "Error: could not write " << partial_file << '\n';
+            return 1;
+        }
+    }
+    else if (!tiled_file.empty()) {
+        // Tiles go straight to disk; the frame is never held in memory.
+        cam.tile_size = distributed_options.tile_size;
+        scoped_phase_timer timer("render");
+        if (!cam.render_tiled(world, tiled_file, true)) {
+            std::cerr << "Error: could not write " << tiled_file << '\n';
+            return 1;
+        }
+    }
+    else
+        cam.render(world);
     auto end_time = std::chrono::system_clock::now();
     auto time = end_time - start_time;
     std::cout << "\nTime taken to render: " <<
             double(std::chrono::duration_cast<std::chrono::milliseconds>(time).count()) / (1000.0) << std::endl;
+
+    std::ofstream stats_file("./render_stats.json");
+    render_stats::write_json(stats_file);
     return 0;
 }
@@ -9,6 +9,9 @@
 #include "texture.h"
 
 
+// Built-in materials that scatter_ray() and emitted_light() call without a virtual call.
+enum class material_kind : unsigned char { other, lambertian, metal, dielectric, diffuse_light, isotropic };
+
 class material {
 public:
     virtual ~material() = default;
@@ -18,19 +21,29 @@ public:
     }
 
     virtual bool scatter(const ray& ray_in, const hit_record& rec, color& attenuation, ray& scattered) const {
+        RT_STAT_INC(scatter_other);
         return false;
     }
 
+    [[nodiscard]] material_kind kind() const { return type_tag; }
+
+protected:
+    explicit material(material_kind kind = material_kind::other) : type_tag(kind) {}
+
+private:
+    material_kind type_tag;
 };
 
 
-class lambertian : public material {
+class lambertian final : public material {
 public:
-    explicit lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
-    explicit lambertian(const shared_ptr<texture> tex)  : tex(tex){}
+    explicit lambertian(const color& albedo)
+        : material(material_kind::lambertian), tex(make_shared<solid_color>(albedo)) {}
+    explicit lambertian(const shared_ptr<texture> tex)  : material(material_kind::lambertian), tex(tex){}
 
     bool scatter(const ray &ray_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
+        RT_STAT_INC(scatter_lambertian);
         auto scatter_direction = rec.normal + random_unit_vector();
 
         // Check if direction is not zero
@@ -38,22 +51,27 @@ public:
             scatter_direction = rec.normal;
 
         scattered = ray(rec.p, scatter_direction, ray_in.time());
-        attenuation = tex->value(rec.u, rec.v, rec.p);
+        RT_STAT_INC(texture_lookups);
+        attenuation = texture_value(*tex, rec.u, rec.v, rec.p);
         return true;
 
     }
 
+    [[nodiscard]] color albedo_at(const hit_record& rec) const { return texture_value(*tex, rec.u, rec.v, rec.p); }
+
 private:
     color albedo;
     shared_ptr<texture> tex;
 };
 
-class metal : public material {
+class metal final : public material {
 public:
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz:1){}
+    metal(const color& albedo, double fuzz)
+        : material(material_kind::metal), albedo(albedo), fuzz(fuzz < 1 ? fuzz:1){}
 
     bool scatter(const ray &ray_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
+        RT_STAT_INC(scatter_metal);
         vec3 reflected = reflect(ray_in.direction(), rec.normal);   // calculating reflected ray's direction
         reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
         scattered = ray(rec.p, reflected, ray_in.time());
@@ -61,17 +79,22 @@ public:
         return dot(scattered.direction(), rec.normal) > 0;
     }
 
+    [[nodiscard]] color albedo_at(const hit_record&) const { return albedo; }
+    [[nodiscard]] double roughness() const { return fuzz; }
+
 private:
     color albedo;
     double fuzz;
 };
 
-class dielectric : public material {
+class dielectric final : public material {
 public:
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(double refraction_index)
+        : material(material_kind::dielectric), refraction_index(refraction_index) {}
 
     bool scatter(const ray &ray_in, const hit_record &rec, color &attenuation, ray &scattered)
     const override {
+        RT_STAT_INC(scatter_dielectric);
         attenuation = color (1.0, 1.0, 1.0);
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
@@ -111,20 +134,94 @@ private:
     }
 };
 
-class diffuse_light : public material {
+class diffuse_light final : public material {
 public:
-    explicit diffuse_light(shared_ptr<texture> tex) : tex(tex) {}
-    explicit diffuse_light(const color& emit) : tex(make_shared<solid_color>(emit)) {}
+    explicit diffuse_light(shared_ptr<texture> tex) : material(material_kind::diffuse_light), tex(tex) {}
+    explicit diffuse_light(const color& emit)
+        : material(material_kind::diffuse_light), tex(make_shared<solid_color>(emit)) {}
 
-    color emitted(double u, double v, const point3& p) {
-        return tex->value(u, v, p);
+    color emitted(double u, double v, const point3& p) override {
+        RT_STAT_INC(texture_lookups);
+        return texture_value(*tex, u, v, p);
     }
 
 private:
     shared_ptr<texture> tex;
 };
 
+// Phase function of a participating medium: scatters into every direction with equal
+// probability, keeping the fraction albedo of the light.
+class isotropic final : public material {
+public:
+    explicit isotropic(const color& albedo)
+        : material(material_kind::isotropic), tex(make_shared<solid_color>(albedo)) {}
+    explicit isotropic(shared_ptr<texture> tex) : material(material_kind::isotropic), tex(tex) {}
+
+    bool scatter(const ray &ray_in, const hit_record &rec, color &attenuation, ray &scattered)
+    const override {
+        scattered = ray(rec.p, random_unit_vector(), ray_in.time());
+        RT_STAT_INC(texture_lookups);
+        attenuation = texture_value(*tex, rec.u, rec.v, rec.p);
+        return true;
+    }
+
+    [[nodiscard]] color albedo_at(const hit_record& rec) const { return texture_value(*tex, rec.u, rec.v, rec.p); }
 
+private:
+    shared_ptr<texture> tex;
+};
 
+// Closed-set dispatch for the path tracer's inner loop: the built-in materials are called
+// directly (and can be inlined); anything else falls back to the virtual functions.
+inline bool scatter_ray(const material& mat, const ray& ray_in, const hit_record& rec,
+                        color& attenuation, ray& scattered) {
+    switch (mat.kind()) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(mat).lambertian::scatter(ray_in, rec, attenuation, scattered);
+        case material_kind::metal:
+            return static_cast<const metal&>(mat).metal::scatter(ray_in, rec, attenuation, scattered);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(mat).dielectric::scatter(ray_in, rec, attenuation, scattered);
+        case material_kind::diffuse_light:
+            return static_cast<const diffuse_light&>(mat).diffuse_light::scatter(ray_in, rec, attenuation, scattered);
+        case material_kind::isotropic:
+            return static_cast<const isotropic&>(mat).isotropic::scatter(ray_in, rec, attenuation, scattered);
+        default:
+            return mat.scatter(ray_in, rec, attenuation, scattered);
+    }
+}
+
+inline color emitted_light(material& mat, double u, double v, const point3& p) {
+    switch (mat.kind()) {
+        case material_kind::lambertian:
+        case material_kind::metal:
+        case material_kind::dielectric:
+        case material_kind::isotropic:
+            return color(0,0,0);
+        case material_kind::diffuse_light:
+            return static_cast<diffuse_light&>(mat).diffuse_light::emitted(u, v, p);
+        default:
+            return mat.emitted(u, v, p);
+    }
+}
+
+// Reflectance of the surface at rec, the albedo feature of the denoiser. Glass and anything
+// unknown report white; lights their emission, clamped to 1.
+inline color surface_albedo(material& mat, const hit_record& rec) {
+    switch (mat.kind()) {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(mat).albedo_at(rec);
+        case material_kind::metal:
+            return static_cast<const metal&>(mat).albedo_at(rec);
+        case material_kind::isotropic:
+            return static_cast<const isotropic&>(mat).albedo_at(rec);
+        case material_kind::diffuse_light: {
+            auto e = emitted_light(mat, rec.u, rec.v, rec.p);
+            return color(std::fmin(e.x(), 1), std::fmin(e.y(), 1), std::fmin(e.z(), 1));
+        }
+        default:
+            return color(1, 1, 1);
+    }
+}
 
 #endif //MATERIAL_H
@@ -0,0 +1,289 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef MEDIUM_H
+#define MEDIUM_H
+
+#include "rt.h"
+
+#include "arena.h"
+#include "hittable.h"
+#include "material.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Participating media: fog, smoke and mist filling the inside of a boundary object. A ray that
+// enters the medium may scatter at a random point inside it; hit() returns that point with an
+// isotropic material, so the path tracer treats it like any other scattering vertex. Shadow
+// rays ask transmittance() how much light gets through instead of whether anything blocks.
+// Boundaries are assumed convex: the medium spans from where a ray enters to where it leaves.
+
+// Where r is inside boundary within ray_t, as the parameter range [t0, t1].
+inline bool medium_span(const hittable& boundary, const ray& r, interval ray_t, double& t0, double& t1) {
+    hit_record enter, leave;
+    if (!boundary.hit(r, interval::universe, enter))
+        return false;
+    if (!boundary.hit(r, interval(enter.t + 0.0001, infinity), leave))
+        return false;
+    t0 = std::fmax(enter.t, std::fmax(ray_t.min, 0));
+    t1 = std::fmin(leave.t, ray_t.max);
+    return t0 < t1;
+}
+
+// The scattering event at distance t along r.
+inline void set_medium_hit(const ray& r, double t, const shared_ptr<material>& phase, hit_record& rec) {
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.normal = vec3(1, 0, 0);     // Arbitrary; isotropic scattering ignores it
+    rec.front_face = true;
+    rec.u = rec.v = 0;
+    rec.mat = phase;
+    rec.object = nullptr;
+}
+
+// A medium of the same density everywhere. The distance to the next scattering event is
+// exponentially distributed and the transmittance is exact: exp(-density * length).
+class constant_medium final : public hittable {
+public:
+    constant_medium(shared_ptr<hittable> boundary, double density, shared_ptr<texture> tex,
+                    scene_arena* arena = nullptr)
+        : boundary(std::move(boundary)), density(density),
+          phase(make_object<isotropic>(arena, std::move(tex))) {}
+
+    constant_medium(shared_ptr<hittable> boundary, double density, const color& albedo,
+                    scene_arena* arena = nullptr)
+        : boundary(std::move(boundary)), density(density),
+          phase(make_object<isotropic>(arena, albedo)) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double t0, t1;
+        if (!medium_span(*boundary, r, ray_t, t0, t1))
+            return false;
+        auto speed = r.direction().length();
+        auto distance = -std::log(1 - random_double()) / density;
+        if (distance >= (t1 - t0) * speed)
+            return false;
+        set_medium_hit(r, t0 + distance / speed, phase, rec);
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return random_double() >= transmittance(r, ray_t);
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        double t0, t1;
+        if (!medium_span(*boundary, r, ray_t, t0, t1))
+            return 1;
+        return std::exp(-density * (t1 - t0) * r.direction().length());
+    }
+
+    aabb bounding_box() const override { return boundary->bounding_box(); }
+
+    void refit() override { boundary->refit(); }
+
+private:
+    shared_ptr<hittable> boundary;
+    double density;
+    shared_ptr<material> phase;
+};
+
+// A medium whose density varies, baked from a density function onto a grid over the
+// boundary's box and interpolated trilinearly. A coarse grid of majorants, the highest density
+// in each cell, drives the tracking: scattering distances are sampled by delta tracking and
+// transmittance is estimated by ratio tracking, both against the majorant of the cell the ray
+// is in. Empty cells are skipped without a single step and thin ones in a few long ones.
+class grid_medium final : public hittable {
+public:
+    // density(p) is sampled at resolution^3 points. majorant_resolution cells per axis hold
+    // the majorants.
+    grid_medium(shared_ptr<hittable> boundary, const std::function<double(const point3&)>& density,
+                const color& albedo, int resolution = 64, int majorant_resolution = 16,
+                scene_arena* arena = nullptr)
+        : boundary(std::move(boundary)), phase(make_object<isotropic>(arena, albedo)),
+          bounds(this->boundary->bounding_box()), resolution(std::max(resolution, 2)),
+          cells(std::clamp(majorant_resolution, 1, this->resolution - 1)) {
+        bake(density);
+        build_majorants();
+    }
+
+    // Density at p, zero outside the grid.
+    [[nodiscard]] double density_at(const point3& p) const {
+        double g[3];
+        int g0[3];
+        auto n = resolution - 1;
+        for (int a = 0; a < 3; a++) {
+            const auto& axis = bounds.axis_interval(a);
+            g[a] = (p[a] - axis.min) / axis.size() * n;
+            if (g[a] < 0 || g[a] > n)
+                return 0;
+            g0[a] = std::min(int(g[a]), n - 1);
+            g[a] -= g0[a];
+        }
+
+        auto accum = 0.0;
+        for (int c = 0; c < 8; c++) {
+            int i = c >> 2, j = c >> 1 & 1, k = c & 1;
+            accum += (i ? g[0] : 1 - g[0]) * (j ? g[1] : 1 - g[1]) * (k ? g[2] : 1 - g[2])
+                   * samples[index(g0[0] + i, g0[1] + j, g0[2] + k)];
+        }
+        return accum;
+    }
+
+    // Delta tracking: tentative collisions at the majorant rate, each a real one with
+    // probability density / majorant.
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double t0, t1;
+        if (!medium_span(*boundary, r, ray_t, t0, t1))
+            return false;
+        auto speed = r.direction().length();
+        double collision = -1;
+        march(r, t0, t1, [&](double t, double t_exit, double majorant) {
+            auto rate = majorant * speed;
+            while (true) {
+                t -= std::log(1 - random_double()) / rate;
+                if (t >= t_exit)
+                    return true;
+                if (random_double() * majorant < density_at(r.at(t))) {
+                    collision = t;
+                    return false;
+                }
+            }
+        });
+        if (collision < 0)
+            return false;
+        set_medium_hit(r, collision, phase, rec);
+        return true;
+    }
+
+    // Delta tracking answers it too: a real collision blocks the ray.
+    bool occluded(const ray& r, interval ray_t) const override {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
+    // Ratio tracking: every tentative collision keeps the fraction 1 - density / majorant.
+    // Once that drops below 0.1 Russian roulette ends most estimates early.
+    double transmittance(const ray& r, interval ray_t) const override {
+        double t0, t1;
+        if (!medium_span(*boundary, r, ray_t, t0, t1))
+            return 1;
+        auto speed = r.direction().length();
+        double fraction = 1;
+        march(r, t0, t1, [&](double t, double t_exit, double majorant) {
+            auto rate = majorant * speed;
+            while (true) {
+                t -= std::log(1 - random_double()) / rate;
+                if (t >= t_exit)
+                    return true;
+                fraction *= 1 - density_at(r.at(t)) / majorant;
+                if (fraction < 0.1) {
+                    if (random_double() >= 0.5) {
+                        fraction = 0;
+                        return false;
+                    }
+                    fraction *= 2;
+                }
+            }
+        });
+        return fraction;
+    }
+
+    aabb bounding_box() const override { return boundary->bounding_box(); }
+
+private:
+    shared_ptr<hittable> boundary;
+    shared_ptr<material> phase;
+    aabb bounds;
+    int resolution;                     // Density samples per axis
+    int cells;                          // Majorant cells per axis
+    std::vector<double> samples;
+    std::vector<double> majorants;
+
+    [[nodiscard]] size_t index(int x, int y, int z) const {
+        return (size_t(z) * resolution + y) * resolution + x;
+    }
+
+    void bake(const std::function<double(const point3&)>& density) {
+        samples.resize(size_t(resolution) * resolution * resolution);
+        auto n = double(resolution - 1);
+        for (int z = 0; z < resolution; z++)
+            for (int y = 0; y < resolution; y++)
+                for (int x = 0; x < resolution; x++) {
+                    point3 p(bounds.x.min + bounds.x.size() * x / n, bounds.y.min + bounds.y.size() * y / n,
+                             bounds.z.min + bounds.z.size() * z / n);
+                    samples[index(x, y, z)] = std::fmax(0, density(p));
+                }
+    }
+
+    // First and last density sample of majorant cell c along an axis. Neighbouring cells share
+    // their border samples, which every voxel they both touch interpolates from.
+    [[nodiscard]] std::pair<int, int> sample_range(int c) const {
+        auto voxels = resolution - 1;
+        return {c * voxels / cells, ((c + 1) * voxels + cells - 1) / cells};
+    }
+
+    // A trilinear interpolation never exceeds its corners, so the largest sample a cell
+    // touches bounds the density everywhere in it.
+    void build_majorants() {
+        majorants.assign(size_t(cells) * cells * cells, 0);
+        for (int cz = 0; cz < cells; cz++)
+            for (int cy = 0; cy < cells; cy++)
+                for (int cx = 0; cx < cells; cx++) {
+                    auto [x0, x1] = sample_range(cx);
+                    auto [y0, y1] = sample_range(cy);
+                    auto [z0, z1] = sample_range(cz);
+                    double highest = 0;
+                    for (int z = z0; z <= z1; z++)
+                        for (int y = y0; y <= y1; y++)
+                            for (int x = x0; x <= x1; x++)
+                                highest = std::fmax(highest, samples[index(x, y, z)]);
+                    majorants[(size_t(cz) * cells + cy) * cells + cx] = highest;
+                }
+    }
+
+    // Walks the majorant cells r passes through between t0 and t1 in order (Amanatides and
+    // Woo), calling visit(t_enter, t_exit, majorant) for each cell with a nonzero majorant
+    // until it returns false.
+    template <typename Visit>
+    void march(const ray& r, double t0, double t1, Visit&& visit) const {
+        int cell[3], step[3];
+        double t_next[3], t_delta[3];
+        auto start = r.at(t0);
+        for (int a = 0; a < 3; a++) {
+            const auto& axis = bounds.axis_interval(a);
+            auto size = axis.size() / cells;
+            auto d = r.direction()[a];
+            cell[a] = std::clamp(int((start[a] - axis.min) / size), 0, cells - 1);
+            if (d == 0) {
+                step[a] = 0;
+                t_next[a] = t_delta[a] = infinity;
+                continue;
+            }
+            step[a] = d > 0 ? 1 : -1;
+            auto border = axis.min + (cell[a] + (d > 0 ? 1 : 0)) * size;
+            t_next[a] = t0 + (border - start[a]) / d;
+            t_delta[a] = size / std::fabs(d);
+        }
+
+        auto t = t0;
+        while (t < t1) {
+            auto a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+            auto t_exit = std::fmin(t_next[a], t1);
+            auto majorant = majorants[(size_t(cell[2]) * cells + cell[1]) * cells + cell[0]];
+            if (majorant > 0 && !visit(t, t_exit, majorant))
+                return;
+
+            t = t_exit;
+            cell[a] += step[a];
+            if (cell[a] < 0 || cell[a] >= cells)
+                return;
+            t_next[a] += t_delta[a];
+        }
+    }
+};
+
+#endif //MEDIUM_H
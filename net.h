@@ -0,0 +1,177 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef NET_H
+#define NET_H
+
+// Minimal blocking TCP sockets for the distributed renderer. POSIX only; on other platforms
+// RT_HAS_SOCKETS is 0 and the distributed modes report that they are unavailable.
+
+#if defined(_WIN32)
+    #define RT_HAS_SOCKETS 0
+#else
+    #define RT_HAS_SOCKETS 1
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+// An owned, connected TCP socket. Move-only; closes the descriptor on destruction.
+class socket_connection {
+public:
+    socket_connection() = default;
+    explicit socket_connection(int fd) : fd(fd) {}
+
+    ~socket_connection() { close(); }
+
+    socket_connection(socket_connection&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    socket_connection& operator=(socket_connection&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd = std::exchange(other.fd, -1);
+        }
+        return *this;
+    }
+
+    socket_connection(const socket_connection&) = delete;
+    socket_connection& operator=(const socket_connection&) = delete;
+
+    [[nodiscard]] bool valid() const { return fd >= 0; }
+
+    // Connects to host:port. Returns an invalid connection on failure.
+    static socket_connection connect_to(const std::string& host, int port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            return {};
+
+        socket_connection connection;
+        for (auto* a = addresses; a != nullptr; a = a->ai_next) {
+            int fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd < 0)
+                continue;
+            if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+                connection = socket_connection(fd);
+                break;
+            }
+            ::close(fd);
+        }
+        freeaddrinfo(addresses);
+
+        if (connection.valid()) {
+            int one = 1;
+            setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return connection;
+    }
+
+    // Limits how long a single receive may block. Zero means no limit.
+    void set_receive_timeout(double seconds) {
+        timeval tv{};
+        tv.tv_sec = time_t(seconds);
+        tv.tv_usec = suseconds_t((seconds - double(tv.tv_sec)) * 1e6);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    bool send_all(const void* data, size_t size) {
+        auto* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            auto sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= size_t(sent);
+        }
+        return true;
+    }
+
+    bool receive_all(void* data, size_t size) {
+        auto* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            auto received = ::recv(fd, bytes, size, 0);
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= size_t(received);
+        }
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+private:
+    int fd = -1;
+};
+
+// A listening TCP socket on all interfaces.
+class socket_listener {
+public:
+    explicit socket_listener(int port) {
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(uint16_t(port));
+
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, 64) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    ~socket_listener() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    socket_listener(const socket_listener&) = delete;
+    socket_listener& operator=(const socket_listener&) = delete;
+
+    [[nodiscard]] bool valid() const { return fd >= 0; }
+
+    // Waits up to timeout_seconds for a connection. Returns an invalid connection on timeout.
+    socket_connection accept(double timeout_seconds) {
+        pollfd p{fd, POLLIN, 0};
+        if (::poll(&p, 1, int(timeout_seconds * 1000)) <= 0)
+            return {};
+
+        int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0)
+            return {};
+
+        int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return socket_connection(client);
+    }
+
+private:
+    int fd = -1;
+};
+
+#endif
+
+#endif //NET_H
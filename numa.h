@@ -0,0 +1,326 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef NUMA_H
+#define NUMA_H
+
+// Memory and CPU placement helpers: NUMA topology, thread pinning and page-level allocation
+// with optional huge pages. Linux only; elsewhere the topology is a single node, pinning does
+// nothing and allocations come from the ordinary heap.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+    #include <dirent.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+#endif
+
+// How large allocations (arena slabs, framebuffers) are backed.
+enum class page_mode {
+    normal,         // Ordinary pages
+    transparent,    // Ask the kernel for transparent huge pages (madvise)
+    huge,           // Explicit huge pages from the hugetlb pool, falling back to transparent
+};
+
+// Page mode for allocations that do not ask for one explicitly. Set it once at start-up.
+inline page_mode& default_page_mode() {
+    static page_mode mode = page_mode::normal;
+    return mode;
+}
+
+struct page_allocation {
+    void* data = nullptr;
+    size_t size = 0;
+};
+
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+// Maps zero-filled memory that is not yet backed by physical pages, so each page ends up on
+// the NUMA node of the thread that first writes to it. Sizes are rounded up to whole huge
+// pages so any mode can be unmapped the same way.
+inline page_allocation allocate_pages(size_t bytes, page_mode mode = default_page_mode()) {
+    auto size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+#if defined(__linux__)
+    void* data = MAP_FAILED;
+    if (mode == page_mode::huge)
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            throw std::bad_alloc();
+        if (mode != page_mode::normal)
+            madvise(data, size, MADV_HUGEPAGE);
+    }
+    return {data, size};
+#else
+    auto* data = std::calloc(1, size);
+    if (!data)
+        throw std::bad_alloc();
+    return {data, size};
+#endif
+}
+
+inline void free_pages(const page_allocation& allocation) {
+    if (!allocation.data)
+        return;
+#if defined(__linux__)
+    munmap(allocation.data, allocation.size);
+#else
+    std::free(allocation.data);
+#endif
+}
+
+// Allocator for large, zero-initialized buffers such as framebuffers. Buffers of at least
+// page_threshold bytes come from allocate_pages (first-touch placement, default page mode);
+// smaller ones from the heap. Default construction leaves the zeroed memory untouched, so
+// creating a buffer does not place its pages on the creating thread's node.
+template <typename T>
+struct page_allocator {
+    using value_type = T;
+
+    static constexpr size_t page_threshold = size_t(1) << 20;
+
+    page_allocator() = default;
+    template <typename U>
+    page_allocator(const page_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        auto bytes = n * sizeof(T);
+        if (bytes >= page_threshold)
+            return static_cast<T*>(allocate_pages(bytes).data);
+        auto* data = ::operator new(bytes);
+        std::memset(data, 0, bytes);
+        return static_cast<T*>(data);
+    }
+
+    void deallocate(T* data, size_t n) {
+        auto bytes = n * sizeof(T);
+        if (bytes >= page_threshold) {
+            auto size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+            free_pages({data, size});
+        }
+        else
+            ::operator delete(data);
+    }
+
+    // The memory is already zero, which is what a default-constructed element holds here.
+    template <typename U>
+    void construct(U*) noexcept {}
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template <typename U>
+    bool operator==(const page_allocator<U>&) const { return true; }
+};
+
+// The CPUs of each NUMA node this process may run on.
+class numa_topology {
+public:
+    std::vector<std::vector<int>> node_cpus;
+
+    static const numa_topology& system() {
+        static const numa_topology topology = detect();
+        return topology;
+    }
+
+    [[nodiscard]] int node_count() const { return int(node_cpus.size()); }
+
+    [[nodiscard]] int node_of_cpu(int cpu) const {
+        return cpu >= 0 && size_t(cpu) < cpu_node.size() ? cpu_node[cpu] : 0;
+    }
+
+    // The node the calling thread is running on right now.
+    [[nodiscard]] int current_node() const {
+#if defined(__linux__)
+        if (node_count() > 1)
+            return node_of_cpu(sched_getcpu());
+#endif
+        return 0;
+    }
+
+private:
+    std::vector<int> cpu_node;      // Node index of every CPU number
+
+    // Parses a sysfs CPU list such as "0-3,8-11".
+    static std::vector<int> parse_cpu_list(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            if (range.empty() || range == "\n")
+                continue;
+            auto dash = range.find('-');
+            int first = std::atoi(range.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    static numa_topology detect() {
+        numa_topology topology;
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        if (auto* dir = opendir("/sys/devices/system/node")) {
+            std::vector<int> nodes;
+            while (auto* entry = readdir(dir)) {
+                int node;
+                if (std::sscanf(entry->d_name, "node%d", &node) == 1)
+                    nodes.push_back(node);
+            }
+            closedir(dir);
+            std::sort(nodes.begin(), nodes.end());
+
+            for (int node : nodes) {
+                std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string list;
+                std::getline(file, list);
+                std::vector<int> cpus;
+                for (int cpu : parse_cpu_list(list))
+                    if (!have_mask || CPU_ISSET(cpu, &allowed))
+                        cpus.push_back(cpu);
+                if (!cpus.empty())
+                    topology.node_cpus.push_back(cpus);
+            }
+        }
+
+        if (topology.node_cpus.empty()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (have_mask && CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            if (!cpus.empty())
+                topology.node_cpus.push_back(cpus);
+        }
+#endif
+        if (topology.node_cpus.empty()) {
+            std::vector<int> cpus;
+            for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+                cpus.push_back(int(cpu));
+            topology.node_cpus.push_back(cpus);
+        }
+
+        for (int node = 0; node < topology.node_count(); node++)
+            for (int cpu : topology.node_cpus[node]) {
+                if (size_t(cpu) >= topology.cpu_node.size())
+                    topology.cpu_node.resize(cpu + 1, 0);
+                topology.cpu_node[cpu] = node;
+            }
+        return topology;
+    }
+};
+
+// How pool threads are placed on CPUs.
+enum class affinity_policy {
+    none,       // Let the scheduler place (and migrate) threads
+    compact,    // Fill the CPUs of node 0 first, then node 1, ...
+    scatter,    // Round-robin over the nodes, so every node gets an equal share of threads
+};
+
+inline bool parse_affinity(const std::string& name, affinity_policy& policy) {
+    if (name == "none")         policy = affinity_policy::none;
+    else if (name == "compact") policy = affinity_policy::compact;
+    else if (name == "scatter") policy = affinity_policy::scatter;
+    else return false;
+    return true;
+}
+
+inline const char* affinity_name(affinity_policy policy) {
+    switch (policy) {
+        case affinity_policy::compact: return "compact";
+        case affinity_policy::scatter: return "scatter";
+        default:                       return "none";
+    }
+}
+
+// The CPU for the index-th thread of a pool under the policy, or -1 for no pinning. Indices
+// beyond the number of CPUs wrap around.
+inline int cpu_for_thread(affinity_policy policy, unsigned index) {
+    const auto& nodes = numa_topology::system().node_cpus;
+    if (policy == affinity_policy::compact) {
+        size_t total = 0;
+        for (const auto& cpus : nodes)
+            total += cpus.size();
+        auto k = index % total;
+        for (const auto& cpus : nodes) {
+            if (k < cpus.size())
+                return cpus[k];
+            k -= cpus.size();
+        }
+    }
+    if (policy == affinity_policy::scatter) {
+        const auto& cpus = nodes[index % nodes.size()];
+        return cpus[(index / nodes.size()) % cpus.size()];
+    }
+    return -1;
+}
+
+// Restricts the calling thread to one CPU. Returns false if that is not possible here.
+inline bool pin_current_thread(int cpu) {
+#if defined(__linux__)
+    if (cpu < 0)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Remembers the calling thread's CPU mask and puts it back on destruction.
+class scoped_affinity_restore {
+public:
+    scoped_affinity_restore() {
+#if defined(__linux__)
+        saved = pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#endif
+    }
+
+    ~scoped_affinity_restore() {
+#if defined(__linux__)
+        if (saved)
+            pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+    }
+
+    // Keeps the current mask instead, e.g. when destroyed on a different thread.
+    void dismiss() {
+#if defined(__linux__)
+        saved = false;
+#endif
+    }
+
+    scoped_affinity_restore(const scoped_affinity_restore&) = delete;
+    scoped_affinity_restore& operator=(const scoped_affinity_restore&) = delete;
+
+private:
+#if defined(__linux__)
+    cpu_set_t mask{};
+    bool saved = false;
+#endif
+};
+
+#endif //NUMA_H
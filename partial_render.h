@@ -0,0 +1,142 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef PARTIAL_RENDER_H
+#define PARTIAL_RENDER_H
+
+#include "rt.h"
+
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Partial accumulation files, for splitting a render by samples instead of tiles: every process
+// renders the whole frame for its own range of sample indices and stores the raw per-pixel sums.
+// Adding the sums of disjoint ranges gives exactly the image one process gets by rendering the
+// same ranges in turn, and an estimate as good as one render of all their samples, however
+// unevenly the cost is spread over the frame.
+//
+// Layout: a text line "RTPARTIAL width height scene scene_seed first_sample sample_count
+// seed_offset variance", then width x height little-endian double RGB sums, rows top first, then
+// as many sums of squared samples if variance is 1. Sums are doubles so that merging is exact.
+
+struct partial_header {
+    int width = 0, height = 0;
+    int scene = 0;
+    unsigned scene_seed = 0;        // Seed the scene was built from
+    int first_sample = 0;           // The file holds samples [first_sample, first_sample + sample_count)
+    int sample_count = 0;
+    unsigned seed_offset = 0;       // Camera seed; ranges only collide within the same offset
+    bool variance = false;
+};
+
+inline bool write_partial(const std::string& filename, const partial_header& header, const framebuffer& fb) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        return false;
+    out << "RTPARTIAL " << header.width << " " << header.height << " " << header.scene << " "
+        << header.scene_seed << " " << header.first_sample << " " << header.sample_count << " "
+        << header.seed_offset << " " << (fb.tracks_variance() ? 1 : 0) << "\n";
+    auto bytes = std::streamsize(fb.sum.size() * sizeof(color));
+    out.write(reinterpret_cast<const char*>(fb.sum.data()), bytes);
+    if (fb.tracks_variance())
+        out.write(reinterpret_cast<const char*>(fb.sum_squares.data()), bytes);
+    return bool(out);
+}
+
+// Reads the text line at the start of a partial file.
+inline bool read_partial_header(std::istream& in, partial_header& header) {
+    std::string magic;
+    int variance = 0;
+    in >> magic >> header.width >> header.height >> header.scene >> header.scene_seed
+       >> header.first_sample >> header.sample_count >> header.seed_offset >> variance;
+    in.get();   // The newline before the sums
+    header.variance = variance != 0;
+    return in && magic == "RTPARTIAL" && header.width > 0 && header.height > 0 && header.sample_count > 0;
+}
+
+// Reads a partial file into header and fb, which then holds sample_count samples per pixel.
+inline bool read_partial(const std::string& filename, partial_header& header, framebuffer& fb) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open() || !read_partial_header(in, header))
+        return false;
+
+    fb = framebuffer(header.width, header.height);
+    fb.samples = header.sample_count;
+    auto bytes = std::streamsize(fb.sum.size() * sizeof(color));
+    in.read(reinterpret_cast<char*>(fb.sum.data()), bytes);
+    if (header.variance) {
+        fb.track_variance();
+        in.read(reinterpret_cast<char*>(fb.sum_squares.data()), bytes);
+    }
+    return bool(in);
+}
+
+// Sums the partial files inputs into merged. They must come from the same scene, seed and image
+// size, and no two with the same seed offset may share a sample index. The sums are added in
+// order of first sample, as a single process rendering the ranges in turn adds them. The result
+// keeps variance only if every input has it. Returns false with a message in error otherwise.
+inline bool merge_partials(const std::vector<std::string>& inputs, framebuffer& merged, std::string& error) {
+    struct part { partial_header header; std::string filename; };
+    std::vector<part> parts;
+    for (const auto& filename : inputs) {
+        partial_header header;
+        std::ifstream in(filename, std::ios::binary);
+        if (!read_partial_header(in, header)) {
+            error = "cannot read " + filename;
+            return false;
+        }
+        parts.push_back({header, filename});
+    }
+    if (parts.empty()) {
+        error = "no partial files";
+        return false;
+    }
+
+    std::stable_sort(parts.begin(), parts.end(), [](const part& a, const part& b) {
+        return a.header.first_sample < b.header.first_sample;
+    });
+    const auto& first = parts.front().header;
+    auto variance = true;
+    for (size_t k = 0; k < parts.size(); k++) {
+        const auto& h = parts[k].header;
+        if (h.width != first.width || h.height != first.height || h.scene != first.scene
+            || h.scene_seed != first.scene_seed) {
+            error = parts[k].filename + " is from a different render than " + parts.front().filename;
+            return false;
+        }
+        for (size_t other = 0; other < k; other++) {
+            const auto& o = parts[other].header;
+            if (o.seed_offset == h.seed_offset && h.first_sample < o.first_sample + o.sample_count) {
+                error = parts[k].filename + " repeats samples of " + parts[other].filename;
+                return false;
+            }
+        }
+        variance = variance && h.variance;
+    }
+
+    merged = framebuffer(first.width, first.height);
+    if (variance)
+        merged.track_variance();
+    framebuffer partial;
+    for (const auto& p : parts) {
+        partial_header header;
+        if (!read_partial(p.filename, header, partial)) {
+            error = "cannot read " + p.filename;
+            return false;
+        }
+        for (size_t k = 0; k < merged.sum.size(); k++) {
+            merged.sum[k] += partial.sum[k];
+            if (variance)
+                merged.sum_squares[k] += partial.sum_squares[k];
+        }
+        merged.samples += header.sample_count;
+    }
+    return true;
+}
+
+#endif //PARTIAL_RENDER_H
@@ -0,0 +1,303 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef PATH_GUIDE_H
+#define PATH_GUIDE_H
+
+#include "rt.h"
+
+#include "aabb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Online path guiding after Müller et al., "Practical Path Guiding for Efficient Light-Transport
+// Simulation". A binary tree over the scene splits space into regions, and every region holds a
+// quadtree over the sphere of directions that learns where incident light comes from. Each
+// progressive pass records the radiance its paths found; between passes the trees are refined
+// where the records are dense, and the next pass samples scattered directions partly from what
+// was learned. Light that only gets in through a narrow gap is then aimed for instead of found
+// by chance.
+
+// Quadtree over directions in the equal-area cylindrical mapping (x = (cos theta + 1) / 2,
+// y = phi / 2 pi), so the density on the unit square is 4 pi times the solid-angle density.
+class direction_tree {
+public:
+    direction_tree() : nodes(1) {}
+
+    // Adds value to the leaf containing direction. Safe to call from several threads.
+    void record(const vec3& direction, double value) {
+        auto [x, y] = to_square(direction);
+        std::uint32_t n = 0;
+        while (true) {
+            auto q = quadrant(x, y);
+            if (nodes[n].child[q] == 0) {
+                std::atomic_ref<double>(nodes[n].sum[q]).fetch_add(value, std::memory_order_relaxed);
+                return;
+            }
+            n = nodes[n].child[q];
+        }
+    }
+
+    // Sets every inner quadrant's sum to the total of its subtree. Call once after recording.
+    void build_sums() { build_sums(0); }
+
+    [[nodiscard]] double total() const { return node_total(nodes[0]); }
+
+    // Draws a direction with probability proportional to the recorded sums; pdf receives its
+    // solid-angle density. The tree must have a positive total.
+    vec3 sample(double u1, double u2, double& pdf) const {
+        double x0 = 0, y0 = 0, size = 1;
+        double density = 1;
+        std::uint32_t n = 0;
+        while (true) {
+            const auto& node = nodes[n];
+            auto total = node_total(node);
+
+            // Pick the column, then the row within it, reusing the random numbers.
+            auto left = node.sum[0] + node.sum[2];
+            int col = u1 * total < left ? 0 : 1;
+            u1 = col == 0 ? u1 * total / left : (u1 * total - left) / (total - left);
+            auto column = node.sum[col] + node.sum[col + 2];
+            int row = u2 * column < node.sum[col] ? 0 : 1;
+            u2 = row == 0 ? u2 * column / node.sum[col] : (u2 * column - node.sum[col]) / node.sum[col + 2];
+
+            auto q = col + 2 * row;
+            density *= 4 * node.sum[q] / total;
+            size *= 0.5;
+            x0 += col * size;
+            y0 += row * size;
+            if (node.child[q] == 0)
+                break;
+            n = node.child[q];
+        }
+        pdf = density / (4 * pi);
+        return from_square(x0 + std::fmin(u1, 1.0) * size, y0 + std::fmin(u2, 1.0) * size);
+    }
+
+    // Solid-angle density with which sample() returns direction.
+    [[nodiscard]] double pdf(const vec3& direction) const {
+        auto [x, y] = to_square(direction);
+        double density = 1;
+        std::uint32_t n = 0;
+        while (true) {
+            const auto& node = nodes[n];
+            auto total = node_total(node);
+            if (total <= 0)
+                return 0;
+            auto q = quadrant(x, y);
+            density *= 4 * node.sum[q] / total;
+            if (node.child[q] == 0 || density == 0)
+                break;
+            n = node.child[q];
+        }
+        return density / (4 * pi);
+    }
+
+    // An empty tree for the next pass, subdivided wherever a quadrant of this (summed) tree
+    // holds more than threshold of the total, and merged back where it no longer does.
+    [[nodiscard]] direction_tree refined(double threshold, int max_depth) const {
+        direction_tree out;
+        auto total = this->total();
+        if (total <= 0)
+            return out;
+        refine_into(out, 0, 0, nodes[0].sum, threshold * total, 1, max_depth);
+        return out;
+    }
+
+    [[nodiscard]] size_t node_count() const { return nodes.size(); }
+
+private:
+    struct node {
+        double sum[4] = {0, 0, 0, 0};           // Per quadrant: x < 0.5 or not, y < 0.5 or not
+        std::uint32_t child[4] = {0, 0, 0, 0};  // Subtree of a quadrant; 0 for a leaf
+    };
+
+    std::vector<node> nodes;
+
+    static double node_total(const node& n) { return n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3]; }
+
+    // Quadrant of the point x, y, which is then rescaled to the quadrant.
+    static int quadrant(double& x, double& y) {
+        int col = x < 0.5 ? 0 : 1;
+        int row = y < 0.5 ? 0 : 1;
+        x = 2 * x - col;
+        y = 2 * y - row;
+        return col + 2 * row;
+    }
+
+    static std::pair<double, double> to_square(const vec3& direction) {
+        auto d = unit_vector(direction);
+        auto phi = std::atan2(d.y(), d.x());
+        if (phi < 0)
+            phi += 2 * pi;
+        return {std::clamp(0.5 * (d.z() + 1), 0.0, 1.0), std::clamp(phi / (2 * pi), 0.0, 1.0)};
+    }
+
+    static vec3 from_square(double x, double y) {
+        auto cos_theta = 2 * x - 1;
+        auto sin_theta = std::sqrt(std::fmax(0, 1 - cos_theta * cos_theta));
+        auto phi = 2 * pi * y;
+        return vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+    }
+
+    double build_sums(std::uint32_t n) {
+        for (int q = 0; q < 4; q++)
+            if (nodes[n].child[q] != 0)
+                nodes[n].sum[q] = build_sums(nodes[n].child[q]);
+        return node_total(nodes[n]);
+    }
+
+    // Refines node n of this tree into node target of out. sums holds the energy of n's
+    // quadrants; a quadrant this tree does not subdivide spreads its energy evenly.
+    void refine_into(direction_tree& out, std::uint32_t target, std::uint32_t n, const double* sums,
+                     double threshold, int depth, int max_depth) const {
+        for (int q = 0; q < 4; q++) {
+            if (sums[q] <= threshold || depth >= max_depth)
+                continue;
+            auto child = std::uint32_t(out.nodes.size());
+            out.nodes[target].child[q] = child;
+            out.nodes.emplace_back();
+
+            auto existing = n != npos ? nodes[n].child[q] : 0;
+            if (existing != 0) {
+                refine_into(out, child, existing, nodes[existing].sum, threshold, depth + 1, max_depth);
+            }
+            else {
+                double quarter[4] = {sums[q] / 4, sums[q] / 4, sums[q] / 4, sums[q] / 4};
+                refine_into(out, child, npos, quarter, threshold, depth + 1, max_depth);
+            }
+        }
+    }
+
+    static constexpr std::uint32_t npos = ~std::uint32_t(0);
+};
+
+class path_guide {
+public:
+    // A region of space and what it has learned.
+    struct region {
+        direction_tree sampling;        // Learned in earlier passes; guides this pass
+        direction_tree building;        // Records of this pass
+        std::atomic<std::uint64_t> records{0};
+
+        // True once there is something to sample from.
+        [[nodiscard]] bool trained() const { return sampling_total > 0; }
+
+        // Record of the radiance found along direction, sampled with density pdf.
+        void record(const vec3& direction, double radiance, double pdf) {
+            records.fetch_add(1, std::memory_order_relaxed);
+            if (radiance > 0 && pdf > 0)
+                building.record(direction, radiance / pdf);
+        }
+
+    private:
+        friend class path_guide;
+        double sampling_total = 0;
+    };
+
+    double guide_fraction = 0.25;       // Share of scattered directions drawn from the guide
+    double split_threshold = 1000;      // Records that split a region in the first pass
+    double refine_threshold = 0.01;     // Energy share that subdivides a direction quadrant
+    int max_direction_depth = 20;
+
+    explicit path_guide(const aabb& bounds) : bounds(bounds), nodes(1) {
+        regions.push_back(std::make_unique<region>());
+        nodes[0].region = 0;
+    }
+
+    // The region containing p.
+    [[nodiscard]] region& region_at(const point3& p) const {
+        double lo[3] = {bounds.x.min, bounds.y.min, bounds.z.min};
+        double hi[3] = {bounds.x.max, bounds.y.max, bounds.z.max};
+        int n = 0;
+        while (nodes[size_t(n)].region < 0) {
+            const auto& node = nodes[size_t(n)];
+            auto mid = 0.5 * (lo[node.axis] + hi[node.axis]);
+            if (p[node.axis] < mid) {
+                hi[node.axis] = mid;
+                n = node.child[0];
+            }
+            else {
+                lo[node.axis] = mid;
+                n = node.child[1];
+            }
+        }
+        return *regions[size_t(nodes[size_t(n)].region)];
+    }
+
+    // Ends a pass: splits regions with many records, then makes what each region recorded its
+    // new sampling distribution. Not thread safe; call it between passes.
+    void end_pass() {
+        iteration++;
+
+        // Halving the records at every split assumes they were spread evenly over the region.
+        auto threshold = split_threshold * std::sqrt(std::pow(2.0, iteration));
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (nodes[n].region < 0)
+                continue;
+            auto& r = *regions[size_t(nodes[n].region)];
+            if (double(r.records) > threshold && nodes[n].depth < max_spatial_depth)
+                split(n);
+        }
+
+        for (auto& r : regions) {
+            r->building.build_sums();
+            r->sampling = std::move(r->building);
+            r->sampling_total = r->sampling.total();
+            r->building = r->sampling.refined(refine_threshold, max_direction_depth);
+            r->records = 0;
+        }
+    }
+
+    [[nodiscard]] int passes() const { return iteration; }
+    [[nodiscard]] size_t region_count() const { return regions.size(); }
+
+private:
+    struct node {
+        int axis = 0;
+        int child[2] = {-1, -1};
+        int region = -1;                // Index into regions for leaves, else -1
+        int depth = 0;
+    };
+
+    static constexpr int max_spatial_depth = 48;
+
+    aabb bounds;
+    std::vector<node> nodes;
+    std::vector<std::unique_ptr<region>> regions;
+    int iteration = 0;
+
+    // Turns leaf n into an inner node whose children both start with its trees and half its
+    // records. Axes are cycled so regions stay roughly cubical. The children are visited by
+    // end_pass later in the same loop and split further if still over the threshold.
+    void split(size_t n) {
+        auto parent = nodes[n].region;
+        auto depth = nodes[n].depth;
+        auto& source = *regions[size_t(parent)];
+        auto half = source.records / 2;
+
+        auto other = std::make_unique<region>();
+        other->sampling = source.sampling;
+        other->building = source.building;
+        other->sampling_total = source.sampling_total;
+        other->records = half;
+        source.records = half;
+        regions.push_back(std::move(other));
+
+        auto left = int(nodes.size());
+        nodes.push_back({0, {-1, -1}, parent, depth + 1});
+        nodes.push_back({0, {-1, -1}, int(regions.size()) - 1, depth + 1});
+        nodes[n].axis = depth % 3;
+        nodes[n].child[0] = left;
+        nodes[n].child[1] = left + 1;
+        nodes[n].region = -1;
+    }
+};
+
+#endif //PATH_GUIDE_H
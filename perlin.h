@@ -5,17 +5,86 @@
 #ifndef PERLIN_H
 #define PERLIN_H
 #include "rt.h"
+#include "aabb.h"
 
-class perlin {
+#include <map>
+#include <mutex>
+#include <vector>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+// The gradient and permutation tables used by perlin. Building them is the expensive part of a
+// noise texture, so the tables are built once per seed and shared by every perlin that asks for
+// the same seed. Gradients are stored as separate x/y/z arrays so the SIMD paths can gather them.
+class perlin_tables {
 public:
-    perlin() {
+    static constexpr int point_count = 256;
+
+    alignas(32) double randvec_x[point_count];
+    alignas(32) double randvec_y[point_count];
+    alignas(32) double randvec_z[point_count];
+    alignas(32) int perm_x[point_count];
+    alignas(32) int perm_y[point_count];
+    alignas(32) int perm_z[point_count];
+
+    // Returns the tables for the given seed, building them on first use.
+    static shared_ptr<const perlin_tables> shared(unsigned seed) {
+        static std::mutex cache_mutex;
+        static std::map<unsigned, shared_ptr<const perlin_tables>> cache;
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto& tables = cache[seed];
+        if (!tables)
+            tables = shared_ptr<const perlin_tables>(new perlin_tables(seed));
+        return tables;
+    }
+
+private:
+    explicit perlin_tables(unsigned seed) {
+        // A private generator keeps the tables independent of the global RNG state, so the same
+        // seed always gives the same noise no matter how many random numbers were drawn before.
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+        for (int i = 0; i < point_count; i++) {
+            randvec_x[i] = distribution(generator);
+            randvec_y[i] = distribution(generator);
+            randvec_z[i] = distribution(generator);
+        }
+
+        perlin_generate_perm(perm_x, generator);
+        perlin_generate_perm(perm_y, generator);
+        perlin_generate_perm(perm_z, generator);
+    }
+
+    // initializes the array, and then permutes
+    static void perlin_generate_perm(int* p, std::mt19937& generator) {
         for (int i = 0; i < point_count; i++)
-            randvec[i] = vec3::random(-1, 1);
+            p[i] = i;
+
+        permute(p, point_count, generator);
+    }
 
-        perlin_generate_perm(perm_x);
-        perlin_generate_perm(perm_y);
-        perlin_generate_perm(perm_z);
+    // Generates a random permutation of an array
+    static void permute(int* p, int n, std::mt19937& generator) {
+        for (int i = n-1; i > 0; i--) {
+            int target = std::uniform_int_distribution<int>(0, i)(generator);
+            int tmp = p[i];
+            p[i] = p[target];
+            p[target] = tmp;
+        }
     }
+};
+
+class perlin {
+public:
+    static constexpr unsigned default_seed = 0;
+
+    perlin() : perlin(default_seed) {}
+
+    explicit perlin(unsigned seed) : tables(perlin_tables::shared(seed)) {}
 
     [[nodiscard]] double noise(const point3& p) const {
         auto u  = p.x() - std::floor(p.x());
@@ -28,21 +97,27 @@ public:
         auto i = int(std::floor(p.x()));
         auto j = int(std::floor(p.y()));
         auto k = int(std::floor(p.z()));
-        vec3 c[2][2][2];      // Values at corner of a cube
-
-        for (int di = 0; di < 2; di++)
-            for (int dj = 0; dj < 2; dj++)
-                for (int dk = 0; dk < 2; dk++) {
-                    c[di][dj][dk] = randvec[
-                       perm_x[(i+di) & 255] ^
-                       perm_y[(j+dj) & 255] ^
-                       perm_z[(k+dk) & 255]
-                       ];
-                    }
-        return perlin_interp(c, u, v, w);
+
+        // Values at the corners of the cube, laid out corner-major (di, dj, dk) so that the
+        // eight dot products and weights below are plain loops the compiler turns into vector
+        // instructions.
+        alignas(32) double cx[8], cy[8], cz[8];
+        for (int c = 0; c < 8; c++) {
+            int index = tables->perm_x[(i + (c >> 2))     & 255] ^
+                        tables->perm_y[(j + (c >> 1 & 1)) & 255] ^
+                        tables->perm_z[(k + (c & 1))      & 255];
+            cx[c] = tables->randvec_x[index];
+            cy[c] = tables->randvec_y[index];
+            cz[c] = tables->randvec_z[index];
+        }
+
+        return perlin_interp(cx, cy, cz, u, v, w);
     }
 
     [[nodiscard]] double turb(const point3& p, int depth) const {
+#if defined(__AVX2__)
+        return turb_avx2(p, depth);
+#else
         auto accum        = 0.0;
         auto temp_p = p;
         auto weight       = 1.0;
@@ -54,50 +129,181 @@ public:
         }
 
         return std::fabs(accum);
+#endif
     }
 
 private:
-    static constexpr int point_count = 256;
-    vec3 randvec[point_count];
-    int perm_x[point_count];
-    int perm_y[point_count];
-    int perm_z[point_count];
-
-    // initializes the array, and then permutes
-    static void perlin_generate_perm(int* p) {
-        for (int i = 0; i < point_count; i++)
-            p[i] = i;
+    shared_ptr<const perlin_tables> tables;
 
-        permute(p, point_count);
+    static double perlin_interp(const double* cx, const double* cy, const double* cz,
+                                double u, double v, double w) {
+        auto uu = u*u*(3-2*u);
+        auto vv = v*v*(3-2*v);
+        auto ww = w*w*(3-2*w);
+        auto accum = 0.0;
+        for (int c = 0; c < 8; c++) {
+            int i = c >> 2, j = c >> 1 & 1, k = c & 1;
+            accum += (i*uu + (1-i)*(1-uu))
+                   * (j*vv + (1-j)*(1-vv))
+                   * (k*ww + (1-k)*(1-ww))
+                   * (cx[c]*(u-i) + cy[c]*(v-j) + cz[c]*(w-k));
+        }
+        return accum;
     }
 
-    // Generates a random permutation of an array
-    static void permute(int* p, int n) {
-        for (int i = n-1; i > 0; i--) {
-            int target = random_int(0, i);
-            int tmp = p[i];
-            p[i] = p[target];
-            p[target] = tmp;
+#if defined(__AVX2__)
+    // Evaluates four octaves at once, one per lane: every lane walks the same eight cube
+    // corners, so the permutation lookups and gradient fetches become gathers and the
+    // interpolation is done for all four octaves in the same registers.
+    [[nodiscard]] double turb_avx2(const point3& p, int depth) const {
+        const __m256d one   = _mm256_set1_pd(1.0);
+        const __m256d two   = _mm256_set1_pd(2.0);
+        const __m256d three = _mm256_set1_pd(3.0);
+        const __m128i mask  = _mm_set1_epi32(255);
+        const __m128i zero_i = _mm_setzero_si128();
+        const __m128i all_i  = _mm_set1_epi32(-1);
+        const __m256d zero_d = _mm256_setzero_pd();
+        const __m256d all_d  = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+        auto smooth = [&](__m256d t) {
+            return _mm256_mul_pd(_mm256_mul_pd(t, t), _mm256_sub_pd(three, _mm256_mul_pd(two, t)));
+        };
+
+        auto accum = 0.0;
+        auto octave_scale  = 1.0;
+        auto octave_weight = 1.0;
+
+        for (int first = 0; first < depth; first += 4) {
+            alignas(32) double scales[4], weights[4];
+            for (int lane = 0; lane < 4; lane++) {
+                bool active = first + lane < depth;
+                scales[lane]  = octave_scale;
+                weights[lane] = active ? octave_weight : 0.0;
+                octave_scale  *= 2;
+                octave_weight *= 0.5;
+            }
+
+            const __m256d s  = _mm256_load_pd(scales);
+            const __m256d px = _mm256_mul_pd(_mm256_set1_pd(p.x()), s);
+            const __m256d py = _mm256_mul_pd(_mm256_set1_pd(p.y()), s);
+            const __m256d pz = _mm256_mul_pd(_mm256_set1_pd(p.z()), s);
+
+            const __m256d fx = _mm256_floor_pd(px);
+            const __m256d fy = _mm256_floor_pd(py);
+            const __m256d fz = _mm256_floor_pd(pz);
+
+            // Smoothed once here and once more in the interpolation, matching noise().
+            const __m256d u = smooth(_mm256_sub_pd(px, fx));
+            const __m256d v = smooth(_mm256_sub_pd(py, fy));
+            const __m256d w = smooth(_mm256_sub_pd(pz, fz));
+            const __m256d uu = smooth(u);
+            const __m256d vv = smooth(v);
+            const __m256d ww = smooth(w);
+
+            const __m128i i = _mm256_cvtpd_epi32(fx);
+            const __m128i j = _mm256_cvtpd_epi32(fy);
+            const __m128i k = _mm256_cvtpd_epi32(fz);
+
+            __m256d sum = _mm256_setzero_pd();
+            for (int c = 0; c < 8; c++) {
+                const int di = c >> 2, dj = c >> 1 & 1, dk = c & 1;
+
+                __m128i hx = _mm_and_si128(_mm_add_epi32(i, _mm_set1_epi32(di)), mask);
+                __m128i hy = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(dj)), mask);
+                __m128i hz = _mm_and_si128(_mm_add_epi32(k, _mm_set1_epi32(dk)), mask);
+                // The masked gathers, with every lane enabled, start from a zeroed source, which
+                // the unmasked forms leave undefined (GCC warns about it).
+                __m128i index = _mm_xor_si128(
+                    _mm_xor_si128(_mm_mask_i32gather_epi32(zero_i, tables->perm_x, hx, all_i, 4),
+                                  _mm_mask_i32gather_epi32(zero_i, tables->perm_y, hy, all_i, 4)),
+                    _mm_mask_i32gather_epi32(zero_i, tables->perm_z, hz, all_i, 4));
+
+                __m256d gx = _mm256_mask_i32gather_pd(zero_d, tables->randvec_x, index, all_d, 8);
+                __m256d gy = _mm256_mask_i32gather_pd(zero_d, tables->randvec_y, index, all_d, 8);
+                __m256d gz = _mm256_mask_i32gather_pd(zero_d, tables->randvec_z, index, all_d, 8);
+
+                __m256d ox = _mm256_sub_pd(u, _mm256_set1_pd(di));
+                __m256d oy = _mm256_sub_pd(v, _mm256_set1_pd(dj));
+                __m256d oz = _mm256_sub_pd(w, _mm256_set1_pd(dk));
+                __m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(gx, ox),
+                                                          _mm256_mul_pd(gy, oy)),
+                                            _mm256_mul_pd(gz, oz));
+
+                __m256d wx = di ? uu : _mm256_sub_pd(one, uu);
+                __m256d wy = dj ? vv : _mm256_sub_pd(one, vv);
+                __m256d wz = dk ? ww : _mm256_sub_pd(one, ww);
+
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_mul_pd(wx, wy),
+                                                       _mm256_mul_pd(wz, dot)));
+            }
+
+            alignas(32) double lanes[4];
+            _mm256_store_pd(lanes, _mm256_mul_pd(sum, _mm256_load_pd(weights)));
+            accum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
         }
 
+        return std::fabs(accum);
     }
+#endif
+};
+
+// A turbulence volume sampled once on a regular grid over a bounded region of the scene.
+// Lookups inside the bounds are a trilinear interpolation of the grid instead of a full
+// multi-octave turb() evaluation; points outside the bounds fall back to the exact noise.
+// Detail finer than the grid spacing is lost, so the resolution should be chosen to match
+// the highest octave that is still visible at the render resolution.
+class baked_perlin {
+public:
+    baked_perlin(const perlin& noise, const aabb& bounds, int resolution, int depth)
+        : noise(noise), bounds(bounds), resolution(std::max(resolution, 2)), depth(depth),
+          samples(size_t(this->resolution) * this->resolution * this->resolution) {
+        auto n = this->resolution;
+        for (int z = 0; z < n; z++)
+            for (int y = 0; y < n; y++)
+                for (int x = 0; x < n; x++)
+                    samples[index(x, y, z)] = noise.turb(grid_point(x, y, z), depth);
+    }
+
+    [[nodiscard]] double turb(const point3& p) const {
+        if (!bounds.x.contains(p.x()) || !bounds.y.contains(p.y()) || !bounds.z.contains(p.z()))
+            return noise.turb(p, depth);
+
+        auto n = resolution - 1;
+        auto gx = (p.x() - bounds.x.min) / bounds.x.size() * n;
+        auto gy = (p.y() - bounds.y.min) / bounds.y.size() * n;
+        auto gz = (p.z() - bounds.z.min) / bounds.z.size() * n;
+
+        auto x0 = std::min(int(gx), n - 1);
+        auto y0 = std::min(int(gy), n - 1);
+        auto z0 = std::min(int(gz), n - 1);
+        auto fx = gx - x0, fy = gy - y0, fz = gz - z0;
 
-    static double perlin_interp(const vec3 c[2][2][2], double u, double v, double w) {
-        auto uu = u*u*(3-2*u);
-        auto vv = v*v*(3-2*v);
-        auto ww = w*w*(3-2*w);
         auto accum = 0.0;
-        for (int i=0; i < 2; i++)
-            for (int j=0; j < 2; j++)
-                for (int k=0; k < 2; k++) {
-                    vec3 weight_v(u-i, v-j, w-k);
-                    accum += (i*uu + (1-i)*(1-uu))
-                           * (j*vv + (1-j)*(1-vv))
-                           * (k*ww + (1-k)*(1-ww))
-                           * dot(c[i][j][k], weight_v);
-                }
+        for (int c = 0; c < 8; c++) {
+            int i = c >> 2, j = c >> 1 & 1, k = c & 1;
+            accum += (i ? fx : 1 - fx) * (j ? fy : 1 - fy) * (k ? fz : 1 - fz)
+                   * samples[index(x0 + i, y0 + j, z0 + k)];
+        }
         return accum;
     }
+
+private:
+    perlin noise;
+    aabb bounds;
+    int resolution;
+    int depth;
+    std::vector<double> samples;
+
+    [[nodiscard]] size_t index(int x, int y, int z) const {
+        return (size_t(z) * resolution + y) * resolution + x;
+    }
+
+    [[nodiscard]] point3 grid_point(int x, int y, int z) const {
+        auto n = double(resolution - 1);
+        return point3(bounds.x.min + bounds.x.size() * x / n,
+                      bounds.y.min + bounds.y.size() * y / n,
+                      bounds.z.min + bounds.z.size() * z / n);
+    }
 };
 
 #endif //PERLIN_H
@@ -5,18 +5,30 @@
 #ifndef QUAD_H
 #define QUAD_H
 
+#include "arena.h"
 #include "hittable.h"
 #include "hittable_list.h"
 
-class quad : public hittable {
+// Parallelogram Q + alpha*u + beta*v for alpha, beta in [0, 1], specialized at compile time on
+// whether u and v each lie along a coordinate axis. The axis-aligned variant (Cornell walls,
+// box faces) finds the plane hit and the plane coordinates with one division each instead of
+// dot and cross products. Use quad and axis_aligned_quad, or make_quad to pick one.
+template <bool AxisAligned>
+class basic_quad : public hittable {
 public:
-    quad(const point3 &Q, const vec3 &u, const vec3 &v, shared_ptr<material> mat)
-        : Q(Q), u(u), v(v), mat(mat) {
+    basic_quad(const point3 &Q, const vec3 &u, const vec3 &v, shared_ptr<material> mat)
+        : hittable(AxisAligned ? hittable_kind::axis_aligned_quad : hittable_kind::quad),
+          Q(Q), u(u), v(v), mat(mat) {
         set_bounding_box();
         auto n = cross(u, v);
         normal = unit_vector(n);
         D = dot(normal, Q);
         w = n / dot(n, n);
+        if constexpr (AxisAligned) {
+            u_axis = dominant_axis(u);
+            v_axis = dominant_axis(v);
+            n_axis = 3 - u_axis - v_axis;
+        }
     }
 
     void set_bounding_box() {
@@ -32,47 +44,55 @@ public:
         return bbox;
     }
 
-    bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
-        auto denom = dot(normal, r.direction());
-
-        // No hit, if ray is parallel to the plane
-        if (std::fabs(denom) <= 1e-8)
-            return false;
-
-        // Return false if hit point parameter t is outside the ray interval
-        auto t = (D - dot(normal, r.origin())) / denom;
-        if (!ray_t.contains(t))
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        if (!plane_hit(r, ray_t, t, alpha, beta))
             return false;
 
         // Determine if the hit point lies within planar shape using its plane coordinates
-        auto intersection = r.at(t);
-        vec3 planar_hitpt_vector = intersection - Q;
-        auto alpha = dot(w, cross(planar_hitpt_vector, v));
-        auto beta = dot(w, cross(u, planar_hitpt_vector));
-
-        if (!is_interior(alpha, beta, rec))
+        if (!contains(alpha, beta))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; set the hit record and return true.
+        rec.u = alpha;
+        rec.v = beta;
         rec.t = t;
-        rec.p = intersection;
+        rec.p = r.at(t);
         rec.mat = mat;
+        rec.object = this;
         rec.set_face_normal(r, normal);
 
         return true;
     }
 
-    virtual bool is_interior(double alpha, double beta, hit_record &rec) const {
-        interval unit_interval = interval(0, 1);
-        // Given the hit point in plane coordinates, return false if it is outside the
-        // primitive, otherwise set the hit record UV coordinates and return true.
+    double surface_area() const override { return cross(u, v).length(); }
 
-        if (!unit_interval.contains(alpha) || !unit_interval.contains(beta))
-            return false;
+    surface_sample sample_surface(double r1, double r2) const override {
+        return {Q + r1 * u + r2 * v, normal, r1, r2};
+    }
 
-        rec.u = alpha;
-        rec.v = beta;
-        return true;
+    shared_ptr<material> surface_material() const override { return mat; }
+
+    bool occluded(const ray &r, interval ray_t) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        return plane_hit(r, ray_t, t, alpha, beta) && contains(alpha, beta);
+    }
+
+    // Whether the point at plane coordinates alpha, beta lies inside the parallelogram.
+    static bool contains(double alpha, double beta) {
+        interval unit_interval = interval(0, 1);
+        return unit_interval.contains(alpha) && unit_interval.contains(beta);
+    }
+
+    // True if u and v each lie along a (different) coordinate axis.
+    static bool is_axis_aligned(const vec3 &u, const vec3 &v) {
+        auto along_axis = [](const vec3 &e) {
+            int nonzero = (e.x() != 0) + (e.y() != 0) + (e.z() != 0);
+            return nonzero == 1;
+        };
+        return along_axis(u) && along_axis(v) && dominant_axis(u) != dominant_axis(v);
     }
 
 private:
@@ -83,14 +103,65 @@ private:
     aabb bbox;
     vec3 normal;
     double D;
+    int u_axis = 0, v_axis = 1, n_axis = 2;     // Axes of u, v and the normal, if AxisAligned
+
+    static int dominant_axis(const vec3 &e) {
+        auto x = std::fabs(e.x()), y = std::fabs(e.y()), z = std::fabs(e.z());
+        return x >= y && x >= z ? 0 : (y >= z ? 1 : 2);
+    }
+
+    // Intersects the ray with the quad's plane. On a hit inside ray_t, returns the ray
+    // parameter and the plane coordinates of the hit point along u and v.
+    bool plane_hit(const ray &r, interval ray_t, double &t, double &alpha, double &beta) const {
+        if constexpr (AxisAligned) {
+            auto denom = r.direction()[n_axis];
+            if (std::fabs(denom) <= 1e-8)
+                return false;
+            t = (Q[n_axis] - r.origin()[n_axis]) / denom;
+            if (!ray_t.contains(t))
+                return false;
+            alpha = (r.origin()[u_axis] + t * r.direction()[u_axis] - Q[u_axis]) / u[u_axis];
+            beta  = (r.origin()[v_axis] + t * r.direction()[v_axis] - Q[v_axis]) / v[v_axis];
+            return true;
+        }
+        else {
+            auto denom = dot(normal, r.direction());
+
+            // No hit, if ray is parallel to the plane
+            if (std::fabs(denom) <= 1e-8)
+                return false;
+
+            // Return false if hit point parameter t is outside the ray interval
+            t = (D - dot(normal, r.origin())) / denom;
+            if (!ray_t.contains(t))
+                return false;
+
+            vec3 planar_hitpt_vector = r.at(t) - Q;
+            alpha = dot(w, cross(planar_hitpt_vector, v));
+            beta = dot(w, cross(u, planar_hitpt_vector));
+            return true;
+        }
+    }
 };
 
+using quad = basic_quad<false>;
+using axis_aligned_quad = basic_quad<true>;
+
+// The quad Q, u, v as the cheaper axis-aligned variant when u and v allow it.
+inline shared_ptr<hittable> make_quad(const point3 &Q, const vec3 &u, const vec3 &v,
+                                      shared_ptr<material> mat, scene_arena* arena = nullptr) {
+    if (quad::is_axis_aligned(u, v))
+        return make_object<axis_aligned_quad>(arena, Q, u, v, std::move(mat));
+    return make_object<quad>(arena, Q, u, v, std::move(mat));
+}
+
 class disk : public hittable {
 public:
     // For this class u and v vectors are purely for orientation and not for the scale of
     // the disk. The disk size is determined by the radius
     disk(const point3 &center, const vec3 &u_, const vec3 &v_, double radius, shared_ptr<material> mat)
-        : center(center), u(unit_vector(u_)), v(unit_vector(v_)), radius(radius),
+        : hittable(hittable_kind::disk),
+          center(center), u(unit_vector(u_)), v(unit_vector(v_)), radius(radius),
           mat(mat) {
         auto n = cross(u, v);
         normal = unit_vector(n);
@@ -107,43 +178,31 @@ public:
         return bbox;
     }
 
-    bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
-        auto denom = dot(normal, r.direction());
-
-        // No hit if the ray is parallel to the plane.
-        if (std::fabs(denom) <= 1e-8)
-            return false;
-
-        // Return false if t is outside ray interval
-        auto t = (D - dot(normal, r.origin())) / denom;
-        if (!ray_t.contains(t))
-            return false;
-
-        auto intersection = r.at(t);
-        vec3 planar_hitpt_vector = intersection - center;
-
-        auto alpha = dot(w, cross(planar_hitpt_vector, v));
-        auto beta = dot(w, cross(u, planar_hitpt_vector));
-
-        if (!is_interior(alpha, beta, rec))
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        if (!plane_hit(r, ray_t, t, alpha, beta) || !contains(alpha, beta))
             return false;
 
+        rec.u = alpha;
+        rec.v = beta;
         rec.t = t;
-        rec.p = intersection;
+        rec.p = r.at(t);
         rec.set_face_normal(r, normal);
         rec.mat = mat;
+        rec.object = this;
         return true;
     }
 
-    virtual bool is_interior(const double alpha, const double beta, hit_record &rec) const {
-        auto unit_interval = interval(0, radius);
-        auto disk = sqrt(alpha * alpha + beta * beta);
-        if (!unit_interval.contains(disk))
-            return false;
+    bool occluded(const ray &r, interval ray_t) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        return plane_hit(r, ray_t, t, alpha, beta) && contains(alpha, beta);
+    }
 
-        rec.u = alpha;
-        rec.v = beta;
-        return true;
+    // Whether the point at plane coordinates alpha, beta lies within radius of the center.
+    [[nodiscard]] bool contains(double alpha, double beta) const {
+        return interval(0, radius).contains(sqrt(alpha * alpha + beta * beta));
     }
 
 private:
@@ -155,13 +214,33 @@ private:
     aabb bbox;
     double D;
     double radius;
+
+    // Intersects the ray with the disk's plane. On a hit inside ray_t, returns the ray
+    // parameter and the plane coordinates of the hit point along u and v.
+    bool plane_hit(const ray &r, interval ray_t, double &t, double &alpha, double &beta) const {
+        auto denom = dot(normal, r.direction());
+
+        // No hit if the ray is parallel to the plane.
+        if (std::fabs(denom) <= 1e-8)
+            return false;
+
+        // Return false if t is outside ray interval
+        t = (D - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        vec3 planar_hitpt_vector = r.at(t) - center;
+        alpha = dot(w, cross(planar_hitpt_vector, v));
+        beta = dot(w, cross(u, planar_hitpt_vector));
+        return true;
+    }
 };
 
 class ellipse : public hittable {
 public:
     // A very similar object to disk
     ellipse(const point3 &Q, const vec3 &u, const vec3 &v, shared_ptr<material> mat)
-        : Q(Q), u(u), v(v), mat(mat) {
+        : hittable(hittable_kind::ellipse), Q(Q), u(u), v(v), mat(mat) {
         set_bounding_box();
         auto n = cross(u, v);
         normal = unit_vector(n);
@@ -182,47 +261,37 @@ public:
         return bbox;
     }
 
-    bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
-        auto denom = dot(normal, r.direction());
-
-        // No hit, if ray is parallel to the plane
-        if (std::fabs(denom) <= 1e-8)
-            return false;
-
-        // Return false if hit point parameter t is outside the ray interval
-        auto t = (D - dot(normal, r.origin())) / denom;
-        if (!ray_t.contains(t))
+    bool hit(const ray &r, interval ray_t, hit_record &rec) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        if (!plane_hit(r, ray_t, t, alpha, beta))
             return false;
 
         // Determine if the hit point lies within planar shape using its plane coordinates
-        auto intersection = r.at(t);
-        vec3 planar_hitpt_vector = intersection - Q;
-        auto alpha = dot(w, cross(planar_hitpt_vector, v));
-        auto beta = dot(w, cross(u, planar_hitpt_vector));
-
-        if (!is_interior(alpha, beta, rec))
+        if (!contains(alpha, beta))
             return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; set the hit record and return true.
+        rec.u = alpha;
+        rec.v = beta;
         rec.t = t;
-        rec.p = intersection;
+        rec.p = r.at(t);
         rec.mat = mat;
+        rec.object = this;
         rec.set_face_normal(r, normal);
 
         return true;
     }
 
-    virtual bool is_interior(double alpha, double beta, hit_record &rec) const {
-        interval unit_interval = interval(0, 2);
-        // Given the hit point in plane coordinates, return false if it is outside the
-        // primitive, otherwise set the hit record UV coordinates and return true.
-        auto sqrtt = sqrt(alpha * alpha + beta * beta);
-        if (!unit_interval.contains(sqrtt))
-            return false;
+    bool occluded(const ray &r, interval ray_t) const final {
+        RT_STAT_INC(primitive_tests);
+        double t, alpha, beta;
+        return plane_hit(r, ray_t, t, alpha, beta) && contains(alpha, beta);
+    }
 
-        rec.u = alpha;
-        rec.v = beta;
-        return true;
+    // Whether the point at plane coordinates alpha, beta lies inside the ellipse.
+    static bool contains(double alpha, double beta) {
+        return interval(0, 2).contains(sqrt(alpha * alpha + beta * beta));
     }
 
 private:
@@ -233,11 +302,32 @@ private:
     aabb bbox;
     vec3 normal;
     double D;
+
+    // Intersects the ray with the ellipse's plane. On a hit inside ray_t, returns the ray
+    // parameter and the plane coordinates of the hit point along u and v.
+    bool plane_hit(const ray &r, interval ray_t, double &t, double &alpha, double &beta) const {
+        auto denom = dot(normal, r.direction());
+
+        // No hit, if ray is parallel to the plane
+        if (std::fabs(denom) <= 1e-8)
+            return false;
+
+        // Return false if hit point parameter t is outside the ray interval
+        t = (D - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        vec3 planar_hitpt_vector = r.at(t) - Q;
+        alpha = dot(w, cross(planar_hitpt_vector, v));
+        beta = dot(w, cross(u, planar_hitpt_vector));
+        return true;
+    }
 };
 
-inline shared_ptr<hittable_list> box (const point3& a, const point3& b, shared_ptr<material> mat) {
+inline shared_ptr<hittable_list> box (const point3& a, const point3& b, shared_ptr<material> mat,
+                                      scene_arena* arena = nullptr) {
     // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
-    auto sides = make_shared<hittable_list>();
+    auto sides = make_object<hittable_list>(arena);
     // Construct the two opposite vertices with the minimum and maximum coordinates.
     auto min = point3(std::fmin(a.x(),b.x()), std::fmin(a.y(),b.y()), std::fmin(a.z(),b.z()));
     auto max = point3(std::fmax(a.x(),b.x()), std::fmax(a.y(),b.y()), std::fmax(a.z(),b.z()));
@@ -246,12 +336,12 @@ inline shared_ptr<hittable_list> box (const point3& a, const point3& b, shared_p
     auto dy = vec3(0, max.y() - min.y(), 0);
     auto dz = vec3(0, 0, max.z() - min.z());
 
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
-    sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
+    sides->add(make_quad(point3(min.x(), min.y(), max.z()),  dx,  dy, mat, arena)); // front
+    sides->add(make_quad(point3(max.x(), min.y(), max.z()), -dz,  dy, mat, arena)); // right
+    sides->add(make_quad(point3(max.x(), min.y(), min.z()), -dx,  dy, mat, arena)); // back
+    sides->add(make_quad(point3(min.x(), min.y(), min.z()),  dz,  dy, mat, arena)); // left
+    sides->add(make_quad(point3(min.x(), max.y(), max.z()),  dx, -dz, mat, arena)); // top
+    sides->add(make_quad(point3(min.x(), min.y(), min.z()),  dx,  dz, mat, arena)); // bottom
 
     return sides;
 }
@@ -0,0 +1,106 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef RAY_SORT_H
+#define RAY_SORT_H
+
+#include "aabb.h"
+#include "lbvh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Ray reordering for coherent traversal. After the first bounce, rays from neighbouring pixels
+// leave in unrelated directions, so tracing them in pixel order touches a different part of the
+// BVH on every ray. Sorting a batch by a Morton code over origin and direction makes rays that
+// start close together and point the same way consecutive, and they then traverse mostly the
+// same nodes while those are still in cache.
+
+// Order in which camera::render_samples traces the bounces of its paths.
+enum class ray_ordering {
+    depth_first,    // Each path to the end before the next one (recursive ray_color)
+    breadth_first,  // A batch of paths one bounce at a time, in pixel order
+    sorted,         // Like breadth_first, with every secondary bounce sorted by ray_sort_key
+};
+
+inline bool parse_ray_ordering(const std::string& name, ray_ordering& ordering) {
+    if (name == "depth")        ordering = ray_ordering::depth_first;
+    else if (name == "breadth") ordering = ray_ordering::breadth_first;
+    else if (name == "sorted")  ordering = ray_ordering::sorted;
+    else return false;
+    return true;
+}
+
+inline const char* ray_ordering_name(ray_ordering ordering) {
+    switch (ordering) {
+        case ray_ordering::breadth_first: return "breadth";
+        case ray_ordering::sorted:        return "sorted";
+        default:                          return "depth";
+    }
+}
+
+// Spreads the low 30 bits of v so there is one zero bit between each of them.
+inline std::uint64_t spread_bits(std::uint64_t v) {
+    v &= 0x3fffffff;
+    v = (v | v << 16) & 0x0000ffff0000ffffULL;
+    v = (v | v << 8)  & 0x00ff00ff00ff00ffULL;
+    v = (v | v << 4)  & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v << 2)  & 0x3333333333333333ULL;
+    v = (v | v << 1)  & 0x5555555555555555ULL;
+    return v;
+}
+
+// 60-bit Morton code over the six ray coordinates, 10 bits each: the origin normalized to the
+// scene bounds and the unit direction mapped from [-1, 1]. Interleaving the 3D codes of both
+// keeps origin and direction equally significant.
+inline std::uint64_t ray_sort_key(const ray& r, const aabb& bounds) {
+    constexpr double scale = double((1 << 10) - 1);
+    auto code3 = [](double x, double y, double z) {
+        auto quantize = [](double v) { return std::uint64_t(std::clamp(v, 0.0, 1.0) * scale); };
+        return lbvh::expand_bits(quantize(x)) << 2 | lbvh::expand_bits(quantize(y)) << 1
+             | lbvh::expand_bits(quantize(z));
+    };
+
+    const auto& o = r.origin();
+    auto normalized = [&](int axis) {
+        const auto& extent = bounds.axis_interval(axis);
+        return extent.size() > 0 ? (o[axis] - extent.min) / extent.size() : 0.5;
+    };
+    auto d = unit_vector(r.direction());
+
+    auto origin = code3(normalized(0), normalized(1), normalized(2));
+    auto direction = code3(0.5 * (d.x() + 1), 0.5 * (d.y() + 1), 0.5 * (d.z() + 1));
+    return spread_bits(origin) << 1 | spread_bits(direction);
+}
+
+// Reorders indices (into rays) so that rays[indices[k]] are in ray_sort_key order. Runs on the
+// calling thread, since it is called per render tile and the tiles already fill the pool.
+template <typename RayOf>
+void sort_rays(std::vector<std::uint32_t>& indices, const aabb& bounds, RayOf ray_of) {
+    std::vector<lbvh::primitive_ref> refs(indices.size());
+    for (size_t k = 0; k < indices.size(); k++)
+        refs[k] = {ray_sort_key(ray_of(indices[k]), bounds), indices[k]};
+
+    thread_pool::serial_scope serial;
+    lbvh::radix_sort(refs);
+    for (size_t k = 0; k < indices.size(); k++)
+        indices[k] = refs[k].index;
+}
+
+// Secondary-bounce work of breadth-first renders, summed over all render threads.
+struct secondary_ray_stats {
+    std::atomic<std::uint64_t> rays{0};
+    std::atomic<std::uint64_t> nanoseconds{0};    // Sorting and tracing, in thread time
+
+    void clear() {
+        rays = 0;
+        nanoseconds = 0;
+    }
+};
+
+#endif //RAY_SORT_H
@@ -0,0 +1,74 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef REPLICATED_SCENE_H
+#define REPLICATED_SCENE_H
+
+#include "hittable.h"
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A read-only scene with one copy (BVH, primitives, textures) per NUMA node. Each ray is
+// traced against the copy on the node of the calling thread, so traversal never reads memory
+// across the socket interconnect. Build the copies with build_per_node.
+class replicated_scene final : public hittable {
+public:
+    explicit replicated_scene(std::vector<shared_ptr<hittable>> replicas)
+        : replicas(std::move(replicas)) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return local().hit(r, ray_t, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return local().occluded(r, ray_t);
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return local().transmittance(r, ray_t);
+    }
+
+    aabb bounding_box() const override { return replicas.front()->bounding_box(); }
+
+    void refit() override {
+        for (auto& replica : replicas)
+            replica->refit();
+    }
+
+    [[nodiscard]] size_t size() const { return replicas.size(); }
+
+private:
+    std::vector<shared_ptr<hittable>> replicas;
+
+    [[nodiscard]] const hittable& local() const {
+        auto node = size_t(thread_pool::current_node());
+        return *replicas[node < replicas.size() ? node : 0];
+    }
+};
+
+// Calls build(node) once for every NUMA node, each on its own thread pinned to a CPU of that
+// node and with parallel work disabled, so everything the build allocates and initializes is
+// first touched on (and placed in) that node's memory. Returns the results indexed by node.
+template <typename Build>
+auto build_per_node(Build build) {
+    const auto& topology = numa_topology::system();
+    std::vector<decltype(build(0))> results(topology.node_count());
+
+    std::vector<std::thread> builders;
+    for (int node = 0; node < topology.node_count(); node++)
+        builders.emplace_back([&, node] {
+            pin_current_thread(topology.node_cpus[node].front());
+            thread_pool::serial_scope serial;
+            results[node] = build(node);
+        });
+    for (auto& builder : builders)
+        builder.join();
+    return results;
+}
+
+#endif //REPLICATED_SCENE_H
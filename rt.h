@@ -27,11 +27,49 @@ inline double degrees_to_radians(double degrees){
     return degrees * pi / 180.0;
 }
 
+// Each thread owns its generator, seeded from std::random_device unless seed_random() is called
+inline std::mt19937& random_generator() {
+    thread_local std::mt19937 generator(std::random_device{}());
+    return generator;
+}
+
+// Reseeds the calling thread's generator, for reproducible renders and benchmarks
+inline void seed_random(unsigned seed) {
+    random_generator().seed(seed);
+}
+
+// Returns a number in [0, 1) from the calling thread's generator, whatever source is installed
+inline double independent_random_double() {
+    thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    return distribution(random_generator());
+}
+
+// Where random_double() takes its numbers from. A sampler (sampler.h) installs itself on the
+// rendering thread, so every sampling routine draws well-distributed sample dimensions
+// without being passed them.
+class sample_source {
+public:
+    virtual ~sample_source() = default;
+    virtual double next() = 0;
+    // Moves to the dimensions reserved for path vertex `bounce`.
+    virtual void start_bounce(int bounce) = 0;
+};
+
+inline sample_source*& current_sample_source() {
+    thread_local sample_source* source = nullptr;
+    return source;
+}
+
 //returns a random, real number in range [0, 1)
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator(std::random_device{}());
-    return distribution(generator);
+    if (auto source = current_sample_source())
+        return source->next();
+    return independent_random_double();
+}
+
+inline void start_sample_bounce(int bounce) {
+    if (auto source = current_sample_source())
+        source->start_bounce(bounce);
 }
 
 //returns a random, real number in range [min, max)
@@ -47,6 +85,7 @@ inline int random_int(int min, int max) {
 #include "color.h"
 #include "interval.h"
 #include "ray.h"
+#include "stats.h"
 #include "vec3.h"
 
 #endif //RT_H
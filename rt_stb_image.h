@@ -82,6 +82,16 @@ public:
 
         return bdata + y*bytes_per_scanline + x*bytes_per_pixel;
     }
+
+    [[nodiscard]] const float* float_pixel_data(int x, int y) const {
+        // Return the address of the three linear RGB floats of the pixel at x,y, unclamped, so
+        // HDR images keep their full range. There must be image data.
+
+        x = clamp(x, 0, image_width);
+        y = clamp(y, 0, image_height);
+
+        return fdata + y*bytes_per_scanline + x*bytes_per_pixel;
+    }
 private:
     const int      bytes_per_pixel = 3;
     float         *fdata = nullptr;         // Linear floating point pixel data
@@ -0,0 +1,320 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rt.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Sample generation. The samples of a pixel take their random numbers from a sampler instead
+// of the thread's generator: dimensions 0-7 of a pixel sample belong to the camera ray (pixel
+// jitter, lens, time) and each path vertex gets the next 16 (scattering, light choice and
+// position, environment, guiding). A sampler spreads every dimension evenly over the samples
+// of the pixel, which lowers the noise for the same sample count compared with independent
+// random numbers. Numbers past a vertex's 16 dimensions come from the generator.
+
+enum class sampler_kind {
+    independent,    // The thread's generator, as before
+    stratified,     // Each dimension split into samples_per_pixel strata, in shuffled order
+    halton,         // Halton sequence, Owen scrambled per pixel
+    sobol,          // Sobol sequence, Owen scrambled per pixel
+};
+
+inline bool parse_sampler_kind(const std::string& name, sampler_kind& kind) {
+    if (name == "independent")     kind = sampler_kind::independent;
+    else if (name == "stratified") kind = sampler_kind::stratified;
+    else if (name == "halton")     kind = sampler_kind::halton;
+    else if (name == "sobol")      kind = sampler_kind::sobol;
+    else return false;
+    return true;
+}
+
+inline const char* sampler_name(sampler_kind kind) {
+    switch (kind) {
+        case sampler_kind::stratified: return "stratified";
+        case sampler_kind::halton:     return "halton";
+        case sampler_kind::sobol:      return "sobol";
+        default:                       return "independent";
+    }
+}
+
+// 32-bit integer hash (the "lowbias32" finalizer).
+inline std::uint32_t hash_u32(std::uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline double u32_to_unit(std::uint32_t x) {
+    return double(x) * 0x1p-32;
+}
+
+// Element i of a pseudo-random permutation of 0..n-1 chosen by p (Kensler, "Correlated
+// Multi-Jittered Sampling").
+inline std::uint32_t permutation_element(std::uint32_t i, std::uint32_t n, std::uint32_t p) {
+    auto w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893dU;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3fU;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69U;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303U;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3U;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfU;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + p) % n;
+}
+
+class sampler : public sample_source {
+public:
+    static constexpr int camera_dimensions = 8;
+    static constexpr int bounce_dimensions = 16;
+
+    explicit sampler(unsigned seed) : seed(seed) {}
+
+    // Starts sample `index` of pixel x, y, at the camera ray's dimensions.
+    void start_pixel_sample(int x, int y, std::uint32_t index) {
+        pixel_seed = hash_u32(std::uint32_t(x) * 0x9e3779b9U ^ hash_u32(std::uint32_t(y) ^ seed));
+        sample_index = index;
+        dimension = 0;
+        limit = camera_dimensions;
+    }
+
+    void start_bounce(int bounce) final {
+        dimension = camera_dimensions + bounce * bounce_dimensions;
+        limit = dimension + bounce_dimensions;
+    }
+
+    double next() final {
+        return dimension < limit ? sample(dimension++) : independent_random_double();
+    }
+
+protected:
+    unsigned seed;
+    std::uint32_t pixel_seed = 0;
+    std::uint32_t sample_index = 0;
+
+    // Component `dimension` of the current pixel sample, in [0, 1).
+    virtual double sample(std::uint32_t dimension) = 0;
+
+private:
+    std::uint32_t dimension = 0;
+    std::uint32_t limit = camera_dimensions;
+};
+
+class independent_sampler final : public sampler {
+public:
+    using sampler::sampler;
+
+protected:
+    double sample(std::uint32_t) override { return independent_random_double(); }
+};
+
+// Latin hypercube sampling: the n samples first..first+n-1 that one render call adds to a pixel
+// fall into the n strata of every dimension once each, in an order shuffled per pixel and
+// dimension. Samples outside that range start another round with new shuffles.
+class stratified_sampler final : public sampler {
+public:
+    stratified_sampler(unsigned seed, int first, int strata)
+        : sampler(seed), first(std::uint32_t(first)), strata(std::uint32_t(std::max(strata, 1))) {}
+
+protected:
+    double sample(std::uint32_t dimension) override {
+        auto round = (sample_index - first) / strata + first * 0x2c1b3c6dU;
+        auto k = (sample_index - first) % strata;
+        auto hash = hash_u32(pixel_seed ^ hash_u32(dimension * 0x68e31da4U ^ round));
+        auto stratum = permutation_element(k, strata, hash);
+        auto jitter = u32_to_unit(hash_u32(hash ^ (k * 0x1b56c4e9U + 0x632be5abU)));
+        return (stratum + jitter) / strata;
+    }
+
+private:
+    std::uint32_t first;
+    std::uint32_t strata;
+};
+
+// The Halton sequence, one prime base per dimension, Owen scrambled per pixel and dimension:
+// every digit is permuted depending on the digits before it, which keeps the stratification
+// of the sequence but breaks the correlation between dimensions with large bases.
+class halton_sampler final : public sampler {
+public:
+    using sampler::sampler;
+
+protected:
+    double sample(std::uint32_t dimension) override {
+        const auto& bases = primes();
+        if (dimension >= bases.size())
+            return independent_random_double();
+        return scrambled_radical_inverse(bases[dimension], sample_index,
+                                         hash_u32(pixel_seed ^ hash_u32(dimension + 1)));
+    }
+
+private:
+    // Digits are scrambled until double precision runs out, past the last nonzero digit of
+    // index too, so the points are spread within their strata (after pbrt-v4).
+    static double scrambled_radical_inverse(std::uint32_t base, std::uint32_t index, std::uint32_t hash) {
+        double inverse_base = 1.0 / base, scale = 1;
+        std::uint64_t reversed = 0;
+        while (1 - scale * inverse_base < 1) {
+            auto digit = index % base;
+            index /= base;
+            auto prefix = std::uint32_t(reversed ^ (reversed >> 32));
+            digit = permutation_element(digit, base, hash_u32(hash ^ hash_u32(prefix)));
+            reversed = reversed * base + digit;
+            scale *= inverse_base;
+        }
+        return std::fmin(double(reversed) * scale, 1 - 0x1p-53);
+    }
+
+    // The first primes, one per dimension a path of maximum depth 50 can use.
+    static const std::vector<std::uint32_t>& primes() {
+        static const std::vector<std::uint32_t> table = [] {
+            std::vector<std::uint32_t> found;
+            for (std::uint32_t n = 2; found.size() < camera_dimensions + 50 * bounce_dimensions; n++) {
+                bool prime = true;
+                for (auto p : found) {
+                    if (p * p > n) break;
+                    if (n % p == 0) { prime = false; break; }
+                }
+                if (prime)
+                    found.push_back(n);
+            }
+            return found;
+        }();
+        return table;
+    }
+};
+
+// Sobol points with hash-based Owen scrambling, padded to any number of dimensions (Burley,
+// "Practical Hash-based Owen Scrambling"): dimensions come in groups of four, each group is the
+// 4D Sobol sequence with its sample order shuffled by a per-pixel, per-group seed, and every
+// component is Owen scrambled with a seed of its own.
+class sobol_sampler final : public sampler {
+public:
+    using sampler::sampler;
+
+protected:
+    double sample(std::uint32_t dimension) override {
+        auto group_seed = hash_u32(pixel_seed ^ hash_u32(dimension / 4 + 0x2545f491U));
+        auto index = nested_uniform_scramble(sample_index, group_seed);
+        auto component = dimension % 4;
+        auto value = nested_uniform_scramble(sobol(index, component), hash_u32(group_seed + component + 1));
+        return u32_to_unit(value);
+    }
+
+private:
+    static std::uint32_t reverse_bits(std::uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+        x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+        x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+        x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+        return x;
+    }
+
+    static std::uint32_t laine_karras_permutation(std::uint32_t x, std::uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cU;
+        x ^= x * 0xb82f1e52U;
+        x ^= x * 0xc7afe638U;
+        x ^= x * 0x8d22f6e6U;
+        return x;
+    }
+
+    static std::uint32_t nested_uniform_scramble(std::uint32_t x, std::uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    // Component d (0-3) of Sobol point `index`, as a 32-bit fraction.
+    static std::uint32_t sobol(std::uint32_t index, std::uint32_t d) {
+        const auto& v = directions()[d];
+        std::uint32_t x = 0;
+        for (int bit = 0; index != 0; index >>= 1, bit++)
+            if (index & 1)
+                x ^= v[bit];
+        return x;
+    }
+
+    // Direction numbers of the first four dimensions: van der Corput, then Joe and Kuo's
+    // dimensions 2-4 (degree s, coefficients a, initial numbers m).
+    static const std::vector<std::vector<std::uint32_t>>& directions() {
+        static const std::vector<std::vector<std::uint32_t>> table = [] {
+            struct polynomial { int s; std::uint32_t a; std::uint32_t m[3]; };
+            const polynomial polynomials[3] = {{1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}};
+
+            std::vector<std::vector<std::uint32_t>> v(4, std::vector<std::uint32_t>(32));
+            for (int i = 0; i < 32; i++)
+                v[0][size_t(i)] = 1U << (31 - i);
+            for (int d = 1; d < 4; d++) {
+                const auto& p = polynomials[d - 1];
+                auto& dv = v[size_t(d)];
+                for (int i = 0; i < 32; i++) {
+                    if (i < p.s) {
+                        dv[size_t(i)] = p.m[i] << (31 - i);
+                        continue;
+                    }
+                    auto x = dv[size_t(i - p.s)] ^ (dv[size_t(i - p.s)] >> p.s);
+                    for (int k = 1; k < p.s; k++)
+                        if ((p.a >> (p.s - 1 - k)) & 1)
+                            x ^= dv[size_t(i - k)];
+                    dv[size_t(i)] = x;
+                }
+            }
+            return v;
+        }();
+        return table;
+    }
+};
+
+// A sampler for rendering sample_count samples per pixel, starting at sample first_sample.
+inline std::unique_ptr<sampler> make_sampler(sampler_kind kind, int first_sample, int sample_count, unsigned seed) {
+    switch (kind) {
+        case sampler_kind::stratified: return std::make_unique<stratified_sampler>(seed, first_sample, sample_count);
+        case sampler_kind::halton:     return std::make_unique<halton_sampler>(seed);
+        case sampler_kind::sobol:      return std::make_unique<sobol_sampler>(seed);
+        default:                       return std::make_unique<independent_sampler>(seed);
+    }
+}
+
+// Makes random_double() draw from a sampler on the calling thread while in scope.
+class sampler_scope {
+public:
+    explicit sampler_scope(sample_source* source) : previous(current_sample_source()) {
+        current_sample_source() = source;
+    }
+    ~sampler_scope() { current_sample_source() = previous; }
+
+    sampler_scope(const sampler_scope&) = delete;
+    sampler_scope& operator=(const sampler_scope&) = delete;
+
+private:
+    sample_source* previous;
+};
+
+#endif //SAMPLER_H
@@ -0,0 +1,116 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef SCALING_BENCH_H
+#define SCALING_BENCH_H
+
+#include "rt.h"
+
+#include "arena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "framebuffer.h"
+#include "numa.h"
+#include "replicated_scene.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+// Thread scaling benchmark. Renders one scene with 1, 2, 4, ... threads under every affinity
+// policy, once with a single copy of the scene and (on machines with more than one NUMA node)
+// once with a copy per node, and reports throughput and parallel efficiency per run. Comparing
+// compact (one socket first) with scatter (all sockets at once) and the replicated runs shows
+// what crossing the socket interconnect costs.
+struct scaling_bench_options {
+    int scene = 10;
+    unsigned seed = 42;
+    int image_width = 200;
+    int samples = 4;                    // Samples per pixel of every timed render
+    unsigned max_threads = thread_pool::default_thread_count();
+};
+
+inline int run_scaling_benchmark(const scene_builder& build, const scaling_bench_options& options,
+                                 std::ostream& out) {
+    const auto& topology = numa_topology::system();
+
+    // The scene built once, with the usual parallel BVH build.
+    scene_arena arena;
+    hittable_list world;
+    camera cam;
+    seed_random(options.seed);
+    if (!build(options.scene, arena, world, cam)) {
+        std::cerr << "Unknown scene " << options.scene << '\n';
+        return 1;
+    }
+    cam.image_width = options.image_width;
+    cam.seed = options.seed;
+    world = hittable_list(arena.make<bvh_node>(world, &arena));
+
+    // One copy per node, each built on that node.
+    std::vector<std::unique_ptr<scene_arena>> replica_arenas;
+    hittable_list replicated;
+    if (topology.node_count() > 1) {
+        for (int node = 0; node < topology.node_count(); node++)
+            replica_arenas.push_back(std::make_unique<scene_arena>());
+        auto replicas = build_per_node([&](int node) -> shared_ptr<hittable> {
+            auto& node_arena = *replica_arenas[node];
+            hittable_list objects;
+            camera unused;
+            seed_random(options.seed);
+            build(options.scene, node_arena, objects, unused);
+            return node_arena.make<bvh_node>(objects, &node_arena);
+        });
+        replicated = hittable_list(make_shared<replicated_scene>(replicas));
+    }
+
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < options.max_threads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(std::max(options.max_threads, 1u));
+
+    out << "{\"scene\": " << options.scene << ", \"numa_nodes\": " << topology.node_count()
+        << ", \"samples\": " << options.samples << "}" << std::endl;
+
+    for (bool replicate : {false, true}) {
+        if (replicate && replicated.objects.empty())
+            break;
+        for (auto policy : {affinity_policy::none, affinity_policy::compact, affinity_policy::scatter}) {
+            double single_thread_rate = 0;
+            for (auto threads : counts) {
+                std::set<int> nodes;
+                if (policy != affinity_policy::none)
+                    for (unsigned t = 0; t < threads; t++)
+                        nodes.insert(topology.node_of_cpu(cpu_for_thread(policy, t)));
+
+                thread_pool pool(threads, policy);
+                cam.pool = &pool;
+
+                framebuffer fb;
+                auto start = std::chrono::steady_clock::now();
+                auto rays = cam.render_samples(replicate ? replicated : world, fb, options.samples);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                cam.pool = nullptr;
+
+                auto rate = double(rays) / elapsed.count();
+                if (threads == 1)
+                    single_thread_rate = rate;
+
+                out << "{\"affinity\": \"" << affinity_name(policy) << "\""
+                    << ", \"replicated\": " << (replicate ? "true" : "false")
+                    << ", \"threads\": " << threads
+                    << ", \"nodes_used\": " << (nodes.empty() ? -1 : int(nodes.size()))
+                    << ", \"seconds\": " << elapsed.count()
+                    << ", \"mrays_per_second\": " << rate / 1e6
+                    << ", \"efficiency\": " << rate / (single_thread_rate * threads)
+                    << "}" << std::endl;
+            }
+        }
+    }
+    return 0;
+}
+
+#endif //SCALING_BENCH_H
@@ -0,0 +1,21 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "arena.h"
+#include "camera.h"
+#include "hittable_list.h"
+
+#include <functional>
+
+// Fills in one of the built-in scenes (objects and camera settings) by number. Returns false
+// for unknown scene numbers. The benchmark runner and the distributed workers all rebuild
+// scenes through this, so every process renders from the same description. Scene objects are
+// allocated from the arena, which must outlive the world.
+using scene_builder =
+    std::function<bool(int scene, scene_arena& arena, hittable_list& world, camera& cam)>;
+
+#endif //SCENE_H
@@ -5,24 +5,32 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
+#include <type_traits>
 #include <utility>
 
+#include "arena.h"
 #include "hittable.h"
 
-class sphere : public hittable {
+// Sphere, specialized at compile time on whether it moves during the shutter interval. The
+// static variant stores its center as a point; only the moving one evaluates a center path at
+// the ray time. Use sphere and moving_sphere, or make_sphere to pick one.
+template <bool Moving>
+class basic_sphere final : public hittable {
 public:
     // Stationary sphere
-    sphere(const point3& static_center, double radius, shared_ptr<material> mat)
-     : center(static_center, vec3(0,0,0)), radius(std::fmax(0, radius)), mat(std::move(mat)),
+    basic_sphere(const point3& static_center, double radius, shared_ptr<material> mat) requires (!Moving)
+     : hittable(hittable_kind::sphere),
+       center(static_center), radius(std::fmax(0, radius)), mat(std::move(mat)),
         radius_squared(radius * radius){
         auto rvec = vec3(radius, radius, radius);
         bbox = aabb(static_center - rvec, static_center + rvec);   // construct a box around the sphere
     }
 
     // Moving Sphere
-    sphere(const point3& center1, const point3& center2, double radius,
-        shared_ptr<material> mat)
-            : center(center1, (center2-center1)), radius(std::fmax(0,radius)), mat(std::move(mat)),
+    basic_sphere(const point3& center1, const point3& center2, double radius,
+        shared_ptr<material> mat) requires Moving
+            : hittable(hittable_kind::moving_sphere),
+              center(center1, (center2-center1)), radius(std::fmax(0,radius)), mat(std::move(mat)),
             radius_squared(radius * radius){
 
         auto rvec = vec3(radius, radius, radius);
@@ -35,7 +43,8 @@ public:
 
     //This function is called by the hit function of the "hittable_list" class
     bool hit (const ray& r, interval ray_t, hit_record& rec) const override{
-        point3 current_center = center.at(r.time());
+        RT_STAT_INC(primitive_tests);
+        point3 current_center = center_at(r.time());
         vec3 oc = current_center - r.origin();                      // Ray origin to Sphere center
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
@@ -62,21 +71,80 @@ public:
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u,rec.v);
         rec.mat = mat;
+        rec.object = this;
 
         return true;
     }
 
+    // Same root search as hit(), without the normal, UV and material lookups.
+    bool occluded(const ray& r, interval ray_t) const override {
+        RT_STAT_INC(primitive_tests);
+        vec3 oc = center_at(r.time()) - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto c = oc.length_squared() - radius_squared;
+        auto discriminant = h*h - a*c;
+
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
 
+    // Only static spheres are sampled as lights.
+    double surface_area() const override {
+        return Moving ? 0 : 4 * pi * radius_squared;
+    }
+
+    surface_sample sample_surface(double r1, double r2) const override {
+        auto z = 1 - 2 * r1;
+        auto r = std::sqrt(std::fmax(0, 1 - z * z));
+        auto phi = 2 * pi * r2;
+        vec3 direction(r * std::cos(phi), r * std::sin(phi), z);
+
+        surface_sample s{center_at(0) + radius * direction, direction, 0, 0};
+        get_sphere_uv(direction, s.u, s.v);
+        return s;
+    }
+
+    shared_ptr<material> surface_material() const override { return mat; }
+
+    // Moves the sphere, for animation. The BVH above it must be refit afterwards.
+    void set_center(const point3& new_center) {
+        if constexpr (Moving)
+            set_center(new_center, new_center);
+        else {
+            center = new_center;
+            auto rvec = vec3(radius, radius, radius);
+            bbox = aabb(new_center - rvec, new_center + rvec);
+        }
+    }
+
+    void set_center(const point3& center1, const point3& center2) requires Moving {
+        center = ray(center1, center2 - center1);
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(aabb(center1 - rvec, center1 + rvec), aabb(center2 - rvec, center2 + rvec));
+    }
+
 private:
-    ray center;
+    std::conditional_t<Moving, ray, point3> center;     // Center path, or fixed center
     double radius;
     double radius_squared;
     shared_ptr<material> mat;
     aabb bbox;
 
+    [[nodiscard]] point3 center_at(double time) const {
+        if constexpr (Moving)
+            return center.at(time);
+        else
+            return center;
+    }
+
     static void get_sphere_uv(const point3& p, double& u, double& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
@@ -93,4 +161,22 @@ private:
     }
 };
 
+using sphere = basic_sphere<false>;
+using moving_sphere = basic_sphere<true>;
+
+// A stationary sphere. Its type stays visible so animation tracks can move its center.
+inline shared_ptr<sphere> make_sphere(const point3& center, double radius, shared_ptr<material> mat,
+                                      scene_arena* arena = nullptr) {
+    return make_object<sphere>(arena, center, radius, std::move(mat));
+}
+
+// A sphere moving from center1 to center2 over the shutter interval, as the cheaper static
+// variant when the two centers are the same.
+inline shared_ptr<hittable> make_sphere(const point3& center1, const point3& center2, double radius,
+                                        shared_ptr<material> mat, scene_arena* arena = nullptr) {
+    if ((center2 - center1).length_squared() == 0)
+        return make_sphere(center1, radius, std::move(mat), arena);
+    return make_object<moving_sphere>(arena, center1, center2, radius, std::move(mat));
+}
+
 #endif //SPHERE_H
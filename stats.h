@@ -0,0 +1,192 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Render statistics: event counters and phase timers.
+//
+// Counters are kept per thread, so incrementing one is a plain add on thread-local memory with
+// no atomics or locks. Every thread's counters are merged when a report is written (and folded
+// into a shared total when a thread exits). Building with RT_NO_STATS defined turns every
+// RT_STAT_* macro into nothing, so an optimized no-stats build carries no counting code at all.
+//
+// Phase timers are coarse (a handful per render) and stay enabled in both builds.
+
+struct render_counters {
+    // Rays by type
+    std::uint64_t camera_rays = 0;
+    std::uint64_t scatter_rays = 0;
+    std::uint64_t shadow_rays = 0;
+
+    // Traversal and intersection work
+    std::uint64_t bvh_nodes_visited = 0;
+    std::uint64_t box_tests = 0;
+    std::uint64_t primitive_tests = 0;
+
+    // Path statistics: path_vertices / paths is the average path depth
+    std::uint64_t paths = 0;
+    std::uint64_t path_vertices = 0;
+
+    // Shading work
+    std::uint64_t texture_lookups = 0;
+    std::uint64_t scatter_lambertian = 0;
+    std::uint64_t scatter_metal = 0;
+    std::uint64_t scatter_dielectric = 0;
+    std::uint64_t scatter_other = 0;
+
+    void merge(const render_counters& other) {
+        camera_rays        += other.camera_rays;
+        scatter_rays       += other.scatter_rays;
+        shadow_rays        += other.shadow_rays;
+        bvh_nodes_visited  += other.bvh_nodes_visited;
+        box_tests          += other.box_tests;
+        primitive_tests    += other.primitive_tests;
+        paths              += other.paths;
+        path_vertices      += other.path_vertices;
+        texture_lookups    += other.texture_lookups;
+        scatter_lambertian += other.scatter_lambertian;
+        scatter_metal      += other.scatter_metal;
+        scatter_dielectric += other.scatter_dielectric;
+        scatter_other      += other.scatter_other;
+    }
+};
+
+class render_stats {
+public:
+    // The calling thread's counters.
+    static render_counters& local() {
+        thread_local thread_slot slot;
+        return slot.counters;
+    }
+
+    // Sum of the counters of every thread that has counted anything so far.
+    static render_counters merged() {
+        auto& self = instance();
+        std::lock_guard<std::mutex> lock(self.mutex);
+        render_counters total = self.retired;
+        for (auto* counters : self.live)
+            total.merge(*counters);
+        return total;
+    }
+
+    static void add_phase_time(const std::string& phase, double seconds) {
+        auto& self = instance();
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.phases[phase] += seconds;
+    }
+
+    // Writes every phase time and the merged counters as a single JSON object.
+    static void write_json(std::ostream& out) {
+        std::map<std::string, double> phases;
+        {
+            auto& self = instance();
+            std::lock_guard<std::mutex> lock(self.mutex);
+            phases = self.phases;
+        }
+
+        out << "{\n  \"phases_seconds\": {";
+        const char* separator = "\n";
+        for (const auto& [name, seconds] : phases) {
+            out << separator << "    \"" << name << "\": " << seconds;
+            separator = ",\n";
+        }
+        out << "\n  },\n";
+
+#ifdef RT_NO_STATS
+        out << "  \"counters_enabled\": false\n}\n";
+#else
+        auto c = merged();
+        auto average_depth = c.paths ? double(c.path_vertices) / double(c.paths) : 0.0;
+
+        out << "  \"counters_enabled\": true,\n"
+            << "  \"rays\": {\n"
+            << "    \"camera\": " << c.camera_rays << ",\n"
+            << "    \"scatter\": " << c.scatter_rays << ",\n"
+            << "    \"shadow\": " << c.shadow_rays << ",\n"
+            << "    \"total\": " << c.camera_rays + c.scatter_rays + c.shadow_rays << "\n"
+            << "  },\n"
+            << "  \"bvh_nodes_visited\": " << c.bvh_nodes_visited << ",\n"
+            << "  \"box_tests\": " << c.box_tests << ",\n"
+            << "  \"primitive_tests\": " << c.primitive_tests << ",\n"
+            << "  \"texture_lookups\": " << c.texture_lookups << ",\n"
+            << "  \"paths\": " << c.paths << ",\n"
+            << "  \"average_path_depth\": " << average_depth << ",\n"
+            << "  \"scatter_calls\": {\n"
+            << "    \"lambertian\": " << c.scatter_lambertian << ",\n"
+            << "    \"metal\": " << c.scatter_metal << ",\n"
+            << "    \"dielectric\": " << c.scatter_dielectric << ",\n"
+            << "    \"other\": " << c.scatter_other << "\n"
+            << "  }\n"
+            << "}\n";
+#endif
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<render_counters*> live;     // Counters of threads that are still running
+    render_counters retired;                // Counters folded in from threads that have exited
+    std::map<std::string, double> phases;
+
+    static render_stats& instance() {
+        static render_stats stats;
+        return stats;
+    }
+
+    // Registers a thread's counters on first use and folds them into the retired total when
+    // the thread exits, so nothing is lost when worker threads finish before the report.
+    struct thread_slot {
+        render_counters counters;
+
+        thread_slot() {
+            auto& self = instance();
+            std::lock_guard<std::mutex> lock(self.mutex);
+            self.live.push_back(&counters);
+        }
+
+        ~thread_slot() {
+            auto& self = instance();
+            std::lock_guard<std::mutex> lock(self.mutex);
+            self.retired.merge(counters);
+            std::erase(self.live, &counters);
+        }
+    };
+};
+
+// Adds the wall-clock time between construction and destruction to the named phase.
+class scoped_phase_timer {
+public:
+    explicit scoped_phase_timer(std::string phase)
+        : phase(std::move(phase)), start(std::chrono::steady_clock::now()) {}
+
+    ~scoped_phase_timer() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        render_stats::add_phase_time(phase, elapsed.count());
+    }
+
+    scoped_phase_timer(const scoped_phase_timer&) = delete;
+    scoped_phase_timer& operator=(const scoped_phase_timer&) = delete;
+
+private:
+    std::string phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef RT_NO_STATS
+    #define RT_STAT_INC(counter)        ((void)0)
+    #define RT_STAT_ADD(counter, value) ((void)0)
+#else
+    #define RT_STAT_INC(counter)        (++render_stats::local().counter)
+    #define RT_STAT_ADD(counter, value) (render_stats::local().counter += (value))
+#endif
+
+#endif //STATS_H
@@ -8,16 +8,30 @@
 #include "perlin.h"
 #include "rt_stb_image.h"
 
+// Built-in textures that texture_value() evaluates without a virtual call.
+enum class texture_kind : unsigned char { other, solid_color, checker, image, noise };
+
 class texture {
 public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    [[nodiscard]] texture_kind kind() const { return type_tag; }
+
+protected:
+    explicit texture(texture_kind kind = texture_kind::other) : type_tag(kind) {}
+
+private:
+    texture_kind type_tag;
 };
 
-class solid_color :public texture {
+// Evaluates any texture, calling the built-in ones directly. Defined after them, below.
+inline color texture_value(const texture& tex, double u, double v, const point3& p);
+
+class solid_color final :public texture {
 public:
-    explicit solid_color(const color& albedo) : albedo(albedo){}
+    explicit solid_color(const color& albedo) : texture(texture_kind::solid_color), albedo(albedo){}
 
     solid_color(double red, double green, double blue) : solid_color(color(red, green, blue)) {}
 
@@ -29,10 +43,10 @@ private:
     color albedo;
 };
 
-class checker_texture : public texture {
+class checker_texture final : public texture {
 public:
     checker_texture(double scale, shared_ptr<texture> even, shared_ptr<texture> odd)
-        : inv_scale(1.0/scale), even(even), odd(odd) {}
+        : texture(texture_kind::checker), inv_scale(1.0/scale), even(even), odd(odd) {}
 
     checker_texture(double scale, const color& c1, const color& c2)
         : checker_texture(scale, make_shared<solid_color>(c1), make_shared<solid_color>(c2)) {}
@@ -44,7 +58,7 @@ public:
 
         bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
 
-        return isEven ? even->value(u, v, p) : odd->value(u, v, p);
+        return isEven ? texture_value(*even, u, v, p) : texture_value(*odd, u, v, p);
     }
 
 
@@ -54,9 +68,9 @@ private:
     shared_ptr<texture> odd;
 };
 
-class image_texture : public texture {
+class image_texture final : public texture {
 public:
-    image_texture(const char* filename) : image(filename) {}
+    image_texture(const char* filename) : texture(texture_kind::image), image(filename) {}
 
     color value(double u, double v, const point3 &p) const override {
         // if we have no texture data, then just return solid cyan as debugging aid
@@ -79,17 +93,44 @@ private:
 
 };
 
-class noise_texture : public texture {
+class noise_texture final : public texture {
 public:
-    explicit noise_texture(double scale) : scale(scale) {}
+    explicit noise_texture(double scale, unsigned seed = perlin::default_seed)
+        : texture(texture_kind::noise), noise(seed), scale(scale) {}
+
+    // Bakes the turbulence over the given bounds into a resolution^3 grid. Worth it for bounded
+    // scenes where the same region is shaded many times; see baked_perlin for the trade-off.
+    noise_texture(double scale, const aabb& bake_bounds, int resolution,
+                  unsigned seed = perlin::default_seed)
+        : texture(texture_kind::noise), noise(seed), scale(scale),
+          baked(make_shared<baked_perlin>(noise, bake_bounds, resolution, turb_depth)) {}
 
     [[nodiscard]] color value(double u, double v, const point3 &p) const override {
-        return color(0.5, 0.5, 0.5) * (1 + std::sin(scale * p.z() + 10 * noise.turb(p, 7)));
+        auto turb = baked ? baked->turb(p) : noise.turb(p, turb_depth);
+        return color(0.5, 0.5, 0.5) * (1 + std::sin(scale * p.z() + 10 * turb));
     }
 
 private:
+    static constexpr int turb_depth = 7;
+
     perlin noise;
     double scale;
+    shared_ptr<baked_perlin> baked;
 };
 
+inline color texture_value(const texture& tex, double u, double v, const point3& p) {
+    switch (tex.kind()) {
+        case texture_kind::solid_color:
+            return static_cast<const solid_color&>(tex).solid_color::value(u, v, p);
+        case texture_kind::checker:
+            return static_cast<const checker_texture&>(tex).checker_texture::value(u, v, p);
+        case texture_kind::image:
+            return static_cast<const image_texture&>(tex).image_texture::value(u, v, p);
+        case texture_kind::noise:
+            return static_cast<const noise_texture&>(tex).noise_texture::value(u, v, p);
+        default:
+            return tex.value(u, v, p);
+    }
+}
+
 #endif //TEXTURE_H
@@ -0,0 +1,269 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads pulling tasks from one shared queue.
+//
+// Threads that wait for work to finish (task_group::wait, parallel_for) run queued tasks
+// themselves while they wait, so tasks may spawn and wait on further tasks without deadlocking
+// the pool, and the calling thread always contributes to the work.
+//
+// With an affinity policy other than none, every thread is pinned to one CPU: worker t to
+// cpu_for_thread(policy, t), and the constructing thread (which takes part as thread 0) until
+// the pool is destroyed.
+class thread_pool {
+public:
+    // A pool with `threads` workers in total, counting the thread that waits on the work, so
+    // thread_pool(1) runs everything on the caller.
+    explicit thread_pool(unsigned threads, affinity_policy affinity = affinity_policy::none)
+        : affinity(affinity), owner(std::this_thread::get_id()) {
+        threads = std::max(threads, 1u);
+        if (affinity != affinity_policy::none) {
+            caller_mask = std::make_unique<scoped_affinity_restore>();
+            pin(0);
+        }
+        for (unsigned t = 1; t < threads; t++)
+            workers.emplace_back([this, t] {
+                if (this->affinity != affinity_policy::none)
+                    pin(t);
+                worker_loop();
+            });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+
+        if (caller_mask) {
+            if (std::this_thread::get_id() == owner)
+                pinned_node() = -1;
+            else
+                caller_mask->dismiss();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // Total number of threads that execute work, including the waiting caller.
+    [[nodiscard]] unsigned size() const { return unsigned(workers.size()) + 1; }
+
+    [[nodiscard]] affinity_policy placement() const { return affinity; }
+
+    // Settings for the global pool. Change them before the first call to global().
+    struct global_config {
+        unsigned threads = default_thread_count();
+        affinity_policy affinity = default_affinity();
+    };
+
+    static global_config& global_options() {
+        static global_config config;
+        return config;
+    }
+
+    // The pool used by the renderer, created on first use from global_options().
+    static thread_pool& global() {
+        static thread_pool pool(global_options().threads, global_options().affinity);
+        return pool;
+    }
+
+    // The RT_THREADS environment variable if set, otherwise the number of hardware threads.
+    static unsigned default_thread_count() {
+        if (auto* env = std::getenv("RT_THREADS"); env && std::atoi(env) > 0)
+            return unsigned(std::atoi(env));
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // The RT_AFFINITY environment variable (none, compact or scatter) if set, otherwise none.
+    static affinity_policy default_affinity() {
+        auto policy = affinity_policy::none;
+        if (auto* env = std::getenv("RT_AFFINITY"))
+            parse_affinity(env, policy);
+        return policy;
+    }
+
+    // The NUMA node of the calling thread: the node it is pinned to, or where it runs now.
+    static int current_node() {
+        auto node = pinned_node();
+        return node >= 0 ? node : numa_topology::system().current_node();
+    }
+
+    // While alive, task_group and parallel_for run all work inline on the calling thread.
+    // Used to keep everything a build allocates on the (pinned) thread that runs it.
+    class serial_scope {
+    public:
+        serial_scope() : previous(serial()) { serial() = true; }
+        ~serial_scope() { serial() = previous; }
+
+        serial_scope(const serial_scope&) = delete;
+        serial_scope& operator=(const serial_scope&) = delete;
+
+    private:
+        bool previous;
+    };
+
+    static bool& serial() {
+        thread_local bool value = false;
+        return value;
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        available.notify_one();
+    }
+
+    // Runs one queued task on the calling thread, if there is one. Returns false if the queue
+    // was empty.
+    bool run_pending_task() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    // Calls body(i) for every i in [0, count), spread dynamically over the pool. Returns once
+    // every call has finished.
+    void parallel_for(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    affinity_policy affinity;
+    std::thread::id owner;
+    std::unique_ptr<scoped_affinity_restore> caller_mask;
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+    static int& pinned_node() {
+        thread_local int node = -1;
+        return node;
+    }
+
+    void pin(unsigned index) {
+        auto cpu = cpu_for_thread(affinity, index);
+        if (pin_current_thread(cpu))
+            pinned_node() = numa_topology::system().node_of_cpu(cpu);
+    }
+
+    void worker_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [&] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// A set of tasks submitted to a pool that can be waited on as a whole.
+class task_group {
+public:
+    explicit task_group(thread_pool& pool = thread_pool::global()) : pool(pool) {}
+
+    ~task_group() { wait(); }
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    void run(std::function<void()> task) {
+        if (thread_pool::serial()) {
+            task();
+            return;
+        }
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit([this, task = std::move(task)] {
+            task();
+            // Decrement under the lock: wait() takes the lock once more before returning, so
+            // the group cannot be destroyed while this task is still touching it.
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                finished.notify_all();
+        });
+    }
+
+    // Waits for every task of this group, running queued tasks (of any group) meanwhile.
+    void wait() {
+        while (true) {
+            if (pending.load(std::memory_order_acquire) == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                return;
+            }
+            if (pool.run_pending_task())
+                continue;
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait_for(lock, std::chrono::microseconds(100),
+                              [&] { return pending.load(std::memory_order_acquire) == 0; });
+        }
+    }
+
+private:
+    thread_pool& pool;
+    std::atomic<size_t> pending{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+inline void thread_pool::parallel_for(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0)
+        return;
+    if (serial()) {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    // Each runner claims the next unprocessed index until none are left, which balances
+    // uneven work (tiles with glass or lights) without any up-front partitioning.
+    std::atomic<size_t> next{0};
+    auto runner = [&] {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            body(i);
+    };
+
+    task_group group(*this);
+    auto helpers = std::min<size_t>(size() - 1, count - 1);
+    for (size_t h = 0; h < helpers; h++)
+        group.run(runner);
+    runner();
+    group.wait();
+}
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,214 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include "rt.h"
+
+#include "framebuffer.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tiled image files, for renders too large to keep in memory (a 32K x 16K poster is 12 GB of
+// color sums). Finished tiles go to disk as they complete and the full frame never exists in
+// RAM: not while rendering, and not while converting the file to a plain image afterwards.
+//
+// Layout: a 64-byte text header "RTTILES width height tile_size samples", then one slot per tile
+// in scanline order. A slot holds tile_size x tile_size little-endian float RGB pixel estimates,
+// rows top first; edge tiles are padded to the full slot. Since a tile's offset follows from its
+// index alone, tiles can be written in any order and read back one at a time.
+
+struct tiled_image_layout {
+    static constexpr std::streamoff header_bytes = 64;
+
+    int width = 0, height = 0;
+    int tile_size = 0;
+    int samples = 0;
+
+    [[nodiscard]] int tiles_x() const { return (width + tile_size - 1) / tile_size; }
+    [[nodiscard]] int tiles_y() const { return (height + tile_size - 1) / tile_size; }
+    [[nodiscard]] std::streamoff slot_bytes() const {
+        return std::streamoff(tile_size) * tile_size * 3 * std::streamoff(sizeof(float));
+    }
+    // File offset of the tile whose top-left pixel is x0, y0.
+    [[nodiscard]] std::streamoff offset(int x0, int y0) const {
+        auto index = std::streamoff(y0 / tile_size) * tiles_x() + x0 / tile_size;
+        return header_bytes + index * slot_bytes();
+    }
+};
+
+// Writes finished tiles from a dedicated thread. submit() only queues a tile; at most
+// queue_capacity tiles wait at a time, and render threads block beyond that, so memory stays
+// bounded by the tiles in flight whatever the image size.
+class tiled_image_writer {
+public:
+    tiled_image_writer(const std::string& filename, const tiled_image_layout& layout, size_t queue_capacity)
+        : layout(layout), capacity(std::max<size_t>(queue_capacity, 1)),
+          out(filename, std::ios::binary | std::ios::trunc) {
+        if (!out.is_open())
+            return;
+        char header[tiled_image_layout::header_bytes];
+        std::snprintf(header, sizeof(header), "RTTILES %d %d %d %d", layout.width, layout.height,
+                      layout.tile_size, layout.samples);
+        std::string padded(header);
+        padded.resize(size_t(tiled_image_layout::header_bytes) - 1, ' ');
+        padded += '\n';
+        out.write(padded.data(), std::streamsize(padded.size()));
+        writer = std::thread([this] { write_loop(); });
+    }
+
+    ~tiled_image_writer() { finish(); }
+
+    tiled_image_writer(const tiled_image_writer&) = delete;
+    tiled_image_writer& operator=(const tiled_image_writer&) = delete;
+
+    [[nodiscard]] bool is_open() const { return writer.joinable(); }
+
+    // Queues the sums of tile t (pixels holds only the tile) for writing.
+    void submit(const tile& t, framebuffer&& pixels) {
+        std::unique_lock<std::mutex> lock(mutex);
+        has_room.wait(lock, [&] { return queue.size() < capacity; });
+        queue.push_back({t, std::move(pixels)});
+        has_work.notify_one();
+    }
+
+    // Writes everything still queued and closes the file. Returns false if a write failed.
+    bool finish() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            has_work.notify_one();
+            writer.join();
+            out.close();
+        }
+        return ok && !out.fail();
+    }
+
+private:
+    struct pending {
+        tile t;
+        framebuffer pixels;
+    };
+
+    tiled_image_layout layout;
+    size_t capacity;
+    std::ofstream out;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable has_work, has_room;
+    std::deque<pending> queue;
+    bool stopping = false;
+    bool ok = true;
+
+    void write_loop() {
+        std::vector<float> slot(size_t(layout.tile_size) * layout.tile_size * 3);
+        while (true) {
+            pending next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                has_work.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                next = std::move(queue.front());
+                queue.pop_front();
+            }
+            has_room.notify_one();
+
+            std::fill(slot.begin(), slot.end(), 0.0f);
+            for (int j = 0; j < next.t.height(); j++)
+                for (int i = 0; i < next.t.width(); i++) {
+                    auto c = next.pixels.pixel(i, j);
+                    auto p = (size_t(j) * layout.tile_size + i) * 3;
+                    slot[p + 0] = float(c.x());
+                    slot[p + 1] = float(c.y());
+                    slot[p + 2] = float(c.z());
+                }
+            out.seekp(layout.offset(next.t.x0, next.t.y0));
+            out.write(reinterpret_cast<const char*>(slot.data()), std::streamsize(slot.size() * sizeof(float)));
+            ok = ok && bool(out);
+        }
+    }
+};
+
+class tiled_image_reader {
+public:
+    tiled_image_layout layout;
+
+    // Opens a tiled image and reads its header. Check is_open() for success.
+    explicit tiled_image_reader(const std::string& filename) : in(filename, std::ios::binary) {
+        std::string magic;
+        in >> magic >> layout.width >> layout.height >> layout.tile_size >> layout.samples;
+        valid = in && magic == "RTTILES" && layout.width > 0 && layout.height > 0 && layout.tile_size > 0;
+    }
+
+    [[nodiscard]] bool is_open() const { return valid; }
+
+    // Reads the tile whose top-left pixel is x0, y0 into slot (tile_size^2 RGB triples).
+    bool read_tile(int x0, int y0, std::vector<float>& slot) {
+        slot.resize(size_t(layout.tile_size) * layout.tile_size * 3);
+        in.clear();
+        in.seekg(layout.offset(x0, y0));
+        in.read(reinterpret_cast<char*>(slot.data()), std::streamsize(slot.size() * sizeof(float)));
+        return bool(in);
+    }
+
+private:
+    std::ifstream in;
+    bool valid = false;
+};
+
+// Converts a tiled image to a PFM (if output ends in ".pfm") or to the renderer's plain PPM,
+// holding one row of tiles in memory at a time.
+inline bool assemble_tiled_image(const std::string& input, const std::string& output) {
+    tiled_image_reader reader(input);
+    if (!reader.is_open())
+        return false;
+    const auto& layout = reader.layout;
+    auto pfm = output.size() >= 4 && output.compare(output.size() - 4, 4, ".pfm") == 0;
+    std::ofstream out(output, pfm ? std::ios::binary : std::ios::out);
+    if (!out.is_open())
+        return false;
+    out << (pfm ? "PF\n" : "P3\n") << layout.width << " " << layout.height << (pfm ? "\n-1.0\n" : "\n255\n");
+
+    // One band of tile_size full-width rows.
+    std::vector<float> band, slot;
+    for (int k = 0; k < layout.tiles_y(); k++) {
+        // PFM stores rows bottom to top, so its bands go in reverse.
+        auto y0 = (pfm ? layout.tiles_y() - 1 - k : k) * layout.tile_size;
+        auto rows = std::min(layout.tile_size, layout.height - y0);
+        band.assign(size_t(rows) * layout.width * 3, 0.0f);
+        for (int x0 = 0; x0 < layout.width; x0 += layout.tile_size) {
+            if (!reader.read_tile(x0, y0, slot))
+                return false;
+            auto columns = std::min(layout.tile_size, layout.width - x0);
+            for (int j = 0; j < rows; j++)
+                std::copy_n(slot.begin() + std::ptrdiff_t(j) * layout.tile_size * 3, columns * 3,
+                            band.begin() + (std::ptrdiff_t(j) * layout.width + x0) * 3);
+        }
+
+        for (int r = 0; r < rows; r++) {
+            auto j = pfm ? rows - 1 - r : r;
+            auto first = band.data() + size_t(j) * layout.width * 3;
+            if (pfm) {
+                out.write(reinterpret_cast<const char*>(first), std::streamsize(size_t(layout.width) * 3 * sizeof(float)));
+                continue;
+            }
+            for (int i = 0; i < layout.width; i++)
+                write_color(out, color(first[3*i + 0], first[3*i + 1], first[3*i + 2]));
+        }
+    }
+    return bool(out);
+}
+
+#endif //TILED_IMAGE_H
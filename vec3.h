@@ -116,22 +116,31 @@ inline vec3 unit_vector(const vec3& v) {
     return v / v.length();
 }
 
+// Both of these map exactly two random numbers, so samplers can stratify them (rejection
+// sampling would use a varying number).
 inline vec3 random_in_unit_disk() {
-    while (true) {
-        vec3 v = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (v.length_squared() < 1)
-            return v;
+    // Concentric mapping of the square onto the disk (Shirley and Chiu)
+    auto a = random_double(-1, 1);
+    auto b = random_double(-1, 1);
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
     }
+    else {
+        r = b;
+        theta = (pi / 2) - (pi / 4) * (a / b);
+    }
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
 }
 
 inline vec3 random_unit_vector() {
-    while (true) {
-        auto p = vec3::random(-1, 1);
-        auto length_sq = p.length_squared();
-        if (length_sq < 1) {
-            return p / std::sqrt(length_sq);
-        }
-    }
+    auto z = 1 - 2 * random_double();
+    auto phi = 2 * pi * random_double();
+    auto r = std::sqrt(std::fmax(0, 1 - z * z));
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
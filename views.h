@@ -0,0 +1,107 @@
+//
+// Created by harka on 19-10-2026.
+//
+
+#ifndef VIEWS_H
+#define VIEWS_H
+
+#include "rt.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+
+#include <string>
+#include <vector>
+
+// Camera sets for multi-view rendering, all derived from a scene's own camera. Render them in
+// one job with camera::render_views so they share the scene and the thread pool.
+
+// A stereo pair: the left and right eye are offset along the camera's horizontal axis and look
+// in parallel, so the pair converges at infinity.
+inline std::vector<camera> stereo_views(const camera& base, double eye_separation) {
+    auto right = unit_vector(cross(base.vup, base.lookfrom - base.lookat));
+    auto offset = (eye_separation / 2) * right;
+
+    std::vector<camera> views(2, base);
+    views[0].lookfrom = base.lookfrom - offset;
+    views[0].lookat   = base.lookat - offset;
+    views[1].lookfrom = base.lookfrom + offset;
+    views[1].lookat   = base.lookat + offset;
+    return views;
+}
+
+// The six faces of a cube map centred on the camera position, in the order +X, -X, +Y, -Y,
+// +Z, -Z. Every face is square with a 90 degree field of view and no defocus blur. The side
+// faces keep +Y up; the top and bottom faces have -Z and +Z up respectively.
+inline std::vector<camera> cube_map_views(const camera& base) {
+    const vec3 directions[6] = {vec3(1,0,0), vec3(-1,0,0), vec3(0,1,0),
+                                vec3(0,-1,0), vec3(0,0,1), vec3(0,0,-1)};
+    const vec3 ups[6]        = {vec3(0,1,0), vec3(0,1,0), vec3(0,0,-1),
+                                vec3(0,0,1), vec3(0,1,0), vec3(0,1,0)};
+
+    std::vector<camera> views(6, base);
+    for (int face = 0; face < 6; face++) {
+        auto& cam = views[face];
+        cam.lookat = base.lookfrom + directions[face];
+        cam.vup = ups[face];
+        cam.vfov = 90;
+        cam.aspect_ratio = 1.0;
+        cam.image_width = int(base.image_width / base.aspect_ratio);
+        cam.defocus_angle = 0;
+    }
+    return views;
+}
+
+// `count` views evenly spaced on a full orbit around the camera's target, starting from the
+// scene camera itself.
+inline std::vector<camera> turntable_views(const camera& base, int count) {
+    auto arm = base.lookfrom - base.lookat;
+    std::vector<camera> views(std::max(count, 1), base);
+    for (size_t k = 0; k < views.size(); k++) {
+        auto angle = 2 * pi * double(k) / double(views.size());
+        views[k].lookfrom = base.lookat + vec3(
+            std::cos(angle) * arm.x() + std::sin(angle) * arm.z(),
+            arm.y(),
+           -std::sin(angle) * arm.x() + std::cos(angle) * arm.z());
+    }
+    return views;
+}
+
+// Renders all views in one pass, writes them to image_view_N.ppm and reports throughput per
+// view as JSON. Returns the process exit code.
+inline int render_multiview(const hittable& world, std::vector<camera>& views, std::ostream& out) {
+    std::vector<framebuffer> images(views.size());
+    std::vector<camera*> cams;
+    std::vector<framebuffer*> targets;
+    for (size_t v = 0; v < views.size(); v++) {
+        cams.push_back(&views[v]);
+        targets.push_back(&images[v]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t rays;
+    {
+        scoped_phase_timer timer("render");
+        rays = camera::render_views(world, cams, targets, 0, true);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    scoped_phase_timer timer("write");
+    for (size_t v = 0; v < images.size(); v++) {
+        auto name = "./image_view_" + std::to_string(v) + ".ppm";
+        if (!write_ppm(name, images[v])) {
+            std::cerr << "Error: could not write " << name << '\n';
+            return 1;
+        }
+    }
+
+    out << "\n{\"views\": " << views.size()
+        << ", \"seconds\": " << elapsed.count()
+        << ", \"seconds_per_view\": " << elapsed.count() / double(views.size())
+        << ", \"mrays_per_second\": " << double(rays) / elapsed.count() / 1e6
+        << ", \"threads\": " << thread_pool::global().size()
+        << "}" << std::endl;
+    return 0;
+}
+
+#endif //VIEWS_H